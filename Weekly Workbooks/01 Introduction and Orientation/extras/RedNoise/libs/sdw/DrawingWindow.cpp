@@ -24,7 +24,10 @@ DrawingWindow::DrawingWindow(int w, int h, bool fullscreen) : width(w), height(h
 	if (!texture) printMessageAndQuit("Could not allocate texture: ", SDL_GetError());
 }
 
+DrawingWindow::DrawingWindow(int w, int h) : width(w), height(h), pixelBuffer(w * h) {}
+
 void DrawingWindow::renderFrame() {
+	if (!renderer) return;  // headless
 	SDL_UpdateTexture(texture, nullptr, pixelBuffer.data(), width * sizeof(uint32_t));
 	SDL_RenderClear(renderer);
 	SDL_RenderCopy(renderer, texture, nullptr, nullptr);
@@ -56,6 +59,7 @@ void DrawingWindow::savePPM(const std::string &filename) const {
 }
 
 bool DrawingWindow::pollForInputEvents(SDL_Event &event) {
+	if (!window) return false;  // headless
 	if (SDL_PollEvent(&event)) {
 		if ((event.type == SDL_QUIT) || ((event.type == SDL_KEYDOWN) && (event.key.keysym.sym == SDLK_ESCAPE))) {
 			SDL_DestroyTexture(texture);
@@ -12,14 +12,16 @@ public:
 	size_t height;
 
 private:
-	SDL_Window *window;
-	SDL_Renderer *renderer;
-	SDL_Texture *texture;
+	SDL_Window *window{};
+	SDL_Renderer *renderer{};
+	SDL_Texture *texture{};
 	std::vector<uint32_t> pixelBuffer;
 
 public:
 	DrawingWindow();
 	DrawingWindow(int w, int h, bool fullscreen);
+	// A headless window: just the pixel buffer, with no SDL window to show it in (e.g. for benchmarking)
+	DrawingWindow(int w, int h);
 	void renderFrame();
 	void savePPM(const std::string &filename) const;
 	void saveBMP(const std::string &filename) const;
@@ -11,6 +11,11 @@ struct ModelTriangle {
 	std::array<TexturePoint, 3> texturePoints{};
 	Colour colour{};
 	glm::vec3 normal{};
+	std::array<glm::vec3, 3> vertexNormals{};  // for smooth shading, normalised
+	// per vertex: xyz points along increasing texture x, and w (1 or -1) says which way the bitangent goes (see
+	// computeTangents)
+	std::array<glm::vec4, 3> vertexTangents{};
+	size_t materialIndex{};
 
 	ModelTriangle();
 	ModelTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, Colour trigColour);
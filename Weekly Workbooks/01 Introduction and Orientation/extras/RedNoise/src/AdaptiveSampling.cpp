@@ -0,0 +1,89 @@
+#include "AdaptiveSampling.h"
+#include <glm/glm.hpp>
+#include "ImageCompare.h"
+
+namespace {
+	glm::vec3 unpackColour(uint32_t colour) {
+		return glm::vec3((colour >> 16) & 255, (colour >> 8) & 255, colour & 255);
+	}
+
+	// Average colour over the square of side size from minX, minY, which already has the sample known at knownX,
+	// knownY in it
+	glm::vec3 sampleSquare(const TraceSample &trace, float minX, float minY, float size, const PixelSample &known,
+			float knownX, float knownY, int depth, uint32_t seed, float contrastThreshold) {
+		float half = size / 2;
+		int knownStratum = (knownX >= minX + half ? 1 : 0) + (knownY >= minY + half ? 2 : 0);
+		PixelSample samples[4];
+		float sampleX[4];
+		float sampleY[4];
+		for (int i = 0; i < 4; i++) {
+			if (i == knownStratum) {
+				samples[i] = known;
+				sampleX[i] = knownX;
+				sampleY[i] = knownY;
+				continue;
+			}
+			uint32_t stratumSeed = sampleHash(seed + i);
+			sampleX[i] = minX + (i % 2 + unitFloat(stratumSeed)) * half;
+			sampleY[i] = minY + (i / 2 + unitFloat(sampleHash(stratumSeed))) * half;
+			samples[i] = trace(sampleX[i], sampleY[i]);
+		}
+
+		bool differ = false;
+		for (int i = 0; i < 4 && !differ; i++) {
+			for (int j = i+1; j < 4 && !differ; j++) differ = samplesDiffer(samples[i], samples[j], contrastThreshold);
+		}
+		glm::vec3 total(0);
+		for (int i = 0; i < 4; i++) {
+			if (!differ || depth <= 1) {
+				total += unpackColour(samples[i].colour);
+			} else {
+				total += sampleSquare(trace, minX + (i % 2) * half, minY + (i / 2) * half, half, samples[i],
+					sampleX[i], sampleY[i], depth - 1, sampleHash(seed ^ (i + 1)), contrastThreshold);
+			}
+		}
+		return total / 4.0f;
+	}
+}
+
+uint32_t sampleHash(uint32_t value) {
+	value ^= value >> 16;
+	value *= 0x7feb352d;
+	value ^= value >> 15;
+	value *= 0x846ca68b;
+	value ^= value >> 16;
+	return value;
+}
+
+float unitFloat(uint32_t value) {
+	return (value >> 8) * (1.0f / 16777216);
+}
+
+bool samplesDiffer(const PixelSample &a, const PixelSample &b, float contrastThreshold) {
+	return a.triangleIndex != b.triangleIndex || colourDistance(a.colour, b.colour) > contrastThreshold;
+}
+
+std::vector<bool> findEdgePixels(const std::vector<PixelSample> &samples, size_t width, size_t height,
+		float contrastThreshold) {
+	std::vector<bool> edges(width * height, false);
+	for (size_t y = 0; y < height; y++) {
+		for (size_t x = 0; x < width; x++) {
+			size_t i = y*width + x;
+			// each pair of neighbours is compared once, marking both
+			if (x+1 < width && samplesDiffer(samples[i], samples[i+1], contrastThreshold)) {
+				edges[i] = edges[i+1] = true;
+			}
+			if (y+1 < height && samplesDiffer(samples[i], samples[i+width], contrastThreshold)) {
+				edges[i] = edges[i+width] = true;
+			}
+		}
+	}
+	return edges;
+}
+
+uint32_t adaptiveSample(const TraceSample &trace, int x, int y, const PixelSample &centre, int maxDepth,
+		float contrastThreshold) {
+	uint32_t seed = sampleHash(uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u);
+	glm::vec3 colour = sampleSquare(trace, x - 0.5f, y - 0.5f, 1, centre, x, y, maxDepth, seed, contrastThreshold);
+	return (255 << 24) + (int(colour.r + 0.5f) << 16) + (int(colour.g + 0.5f) << 8) + int(colour.b + 0.5f);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// What one ray through the image came back with
+struct PixelSample {
+	uint32_t triangleIndex;  // NO_TRIANGLE for a miss
+	uint32_t colour;  // packed ARGB
+};
+
+// Traces a ray through a point on the canvas, in pixels (pixel x, y is centred on x, y)
+typedef std::function<PixelSample(float x, float y)> TraceSample;
+
+// Integer hash with good avalanche, for sampling jitter that looks random but is the same every frame
+uint32_t sampleHash(uint32_t value);
+// 0 (inclusive) to 1 (exclusive) from the top 24 bits of a hash
+float unitFloat(uint32_t value);
+
+// Samples on different triangles, or whose colours are further apart than contrastThreshold (see colourDistance),
+// probably have an edge between them
+bool samplesDiffer(const PixelSample &a, const PixelSample &b, float contrastThreshold);
+
+// Marks the pixels of a one-sample-per-pixel image that differ from a neighbour above, below, left or right of them
+std::vector<bool> findEdgePixels(const std::vector<PixelSample> &samples, size_t width, size_t height,
+	float contrastThreshold);
+
+// Colour of the pixel centred on x, y, which has already been sampled at its centre. The pixel is split into 2x2
+// strata with one jittered sample each (the centre sample counts for the stratum it falls in), and if any of those
+// samples differ each stratum is split the same way, up to maxDepth times, so a pixel gets 4 to 4^maxDepth samples.
+// A negative contrastThreshold makes every sample differ, which gives plain stratified supersampling.
+// Jitter comes from a hash of the pixel, so the same pixel is always sampled in the same places.
+uint32_t adaptiveSample(const TraceSample &trace, int x, int y, const PixelSample &centre, int maxDepth,
+	float contrastThreshold);
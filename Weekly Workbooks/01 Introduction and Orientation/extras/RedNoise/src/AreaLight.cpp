@@ -0,0 +1,69 @@
+#include "AreaLight.h"
+#include <cmath>
+#include "AdaptiveSampling.h"
+
+namespace {
+	// Counts the unblocked rays to a jittered gridSize x gridSize grid of points on the light
+	int countUnoccluded(const AreaLight &light, const glm::vec3 &centre, const IsOccluded &isOccluded, int gridSize,
+			uint32_t seed) {
+		int unoccluded = 0;
+		for (int i = 0; i < gridSize*gridSize; i++) {
+			if (!isOccluded(penumbraPoint(light, centre, gridSize, i, seed))) unoccluded++;
+		}
+		return unoccluded;
+	}
+}
+
+AreaLight::AreaLight() = default;
+AreaLight::AreaLight(LightShape lightShape, const glm::vec3 &u, const glm::vec3 &v) :
+		shape(lightShape), uAxis(u), vAxis(v) {}
+
+glm::vec3 AreaLight::pointOnLight(const glm::vec3 &centre, float s, float t) const {
+	float a = 2*s - 1;
+	float b = 2*t - 1;
+	if (shape == POINT_LIGHT) return centre;
+	if (shape == RECTANGLE_LIGHT) return centre + a*uAxis + b*vAxis;
+
+	// Shirley and Chiu's concentric mapping: squares around the middle of the unit square go to rings of the disk
+	if (a == 0 && b == 0) return centre;
+	float radius;
+	float angle;
+	if (std::abs(a) > std::abs(b)) {
+		radius = a;
+		angle = float(M_PI/4) * (b/a);
+	} else {
+		radius = b;
+		angle = float(M_PI/2) - float(M_PI/4) * (a/b);
+	}
+	return centre + radius * (std::cos(angle)*uAxis + std::sin(angle)*vAxis);
+}
+
+int AreaLight::cornerCount() const {
+	return shape == POINT_LIGHT ? 1 : 4;
+}
+
+glm::vec3 AreaLight::cornerPoint(const glm::vec3 &centre, int corner) const {
+	return pointOnLight(centre, corner % 2, corner / 2);
+}
+
+float lightVisibility(const AreaLight &light, const glm::vec3 &centre, const IsOccluded &isOccluded,
+		int penumbraGridSize, uint32_t seed) {
+	int corners = light.cornerCount();
+	int unoccludedCorners = 0;
+	for (int corner = 0; corner < corners; corner++) {
+		if (!isOccluded(light.cornerPoint(centre, corner))) unoccludedCorners++;
+	}
+	if (unoccludedCorners == 0 || unoccludedCorners == corners) return float(unoccludedCorners) / corners;
+	return float(countUnoccluded(light, centre, isOccluded, penumbraGridSize, seed)) /
+		(penumbraGridSize*penumbraGridSize);
+}
+
+glm::vec3 penumbraPoint(const AreaLight &light, const glm::vec3 &centre, int penumbraGridSize, int index,
+		uint32_t seed) {
+	int i = index % penumbraGridSize;
+	int j = index / penumbraGridSize;
+	uint32_t stratumSeed = sampleHash(seed + index);
+	float s = (i + unitFloat(stratumSeed)) / penumbraGridSize;
+	float t = (j + unitFloat(sampleHash(stratumSeed))) / penumbraGridSize;
+	return light.pointOnLight(centre, s, t);
+}
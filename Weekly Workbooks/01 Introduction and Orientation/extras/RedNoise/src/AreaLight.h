@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+
+enum LightShape { POINT_LIGHT, RECTANGLE_LIGHT, DISK_LIGHT };
+
+// A light with an area, for soft shadows. It's centred on the light position and lies in the plane of two axes: for a
+// rectangle they go from the centre to the middle of two adjacent edges, and for a disk their lengths are its radius.
+struct AreaLight {
+	LightShape shape{POINT_LIGHT};
+	glm::vec3 uAxis{};
+	glm::vec3 vAxis{};
+
+	AreaLight();
+	AreaLight(LightShape lightShape, const glm::vec3 &u, const glm::vec3 &v);
+	// The point on the light for s and t from 0 to 1. Equal areas of the unit square map to equal areas of the light
+	// (a disk uses the concentric mapping), so stratified s and t give stratified points on the light.
+	glm::vec3 pointOnLight(const glm::vec3 &centre, float s, float t) const;
+	// The points lightVisibility shoots its first shadow rays to: a point light's centre or an area light's corners
+	int cornerCount() const;
+	glm::vec3 cornerPoint(const glm::vec3 &centre, int corner) const;
+};
+
+// Whether something blocks the point being lit from a point on the light
+typedef std::function<bool(const glm::vec3 &lightPoint)> IsOccluded;
+
+// Fraction of an area light that reaches a point. Shoots shadow rays to the light's four corners first, and only if
+// they don't all agree (so the point is in a penumbra) to a jittered penumbraGridSize x penumbraGridSize grid over the
+// light. Edges of shadows on the light usually cross its rim, so the corners rarely miss a penumbra. A point light
+// takes one shadow ray. The seed picks the jitter.
+float lightVisibility(const AreaLight &light, const glm::vec3 &centre, const IsOccluded &isOccluded,
+	int penumbraGridSize, uint32_t seed);
+// Point index (of penumbraGridSize squared, row by row) of the jittered grid lightVisibility uses in a penumbra
+glm::vec3 penumbraPoint(const AreaLight &light, const glm::vec3 &centre, int penumbraGridSize, int index,
+	uint32_t seed);
@@ -0,0 +1,113 @@
+#include "Bench.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+BenchResult::BenchResult() = default;
+
+BenchResult::BenchResult(std::string n, size_t triangleCount) : name(std::move(n)), triangles(triangleCount) {}
+
+double BenchResult::totalSeconds() const {
+	return std::accumulate(frameMilliseconds.begin(), frameMilliseconds.end(), 0.0) / 1000;
+}
+
+double BenchResult::percentileFrameMilliseconds(double percentile) const {
+	if (frameMilliseconds.empty()) return 0;
+	std::vector<double> sorted = frameMilliseconds;
+	std::sort(sorted.begin(), sorted.end());
+	size_t rank = size_t(std::ceil(percentile / 100 * sorted.size()));
+	return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+}
+
+double BenchResult::raysPerSecond() const {
+	return rayStats.rays() / totalSeconds();
+}
+
+double BenchResult::trianglesPerSecond() const {
+	return triangles * frameMilliseconds.size() / totalSeconds();
+}
+
+long peakRssKilobytes() {
+#if defined(__unix__) || defined(__APPLE__)
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;  // bytes on macOS
+#else
+	return usage.ru_maxrss;
+#endif
+#else
+	return 0;
+#endif
+}
+
+void writeBenchJson(std::ostream &os, const std::vector<BenchResult> &results) {
+	// one scenario per line, which readBenchBaseline relies on
+	os << "{\n\t\"scenarios\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult &result = results[i];
+		double rays = std::max(result.rayStats.rays(), uint64_t(1));
+		os << "\t\t{\"name\": \"" << result.name << "\""
+			<< ", \"frames\": " << result.frameMilliseconds.size()
+			<< ", \"triangles\": " << result.triangles
+			<< ", \"medianFrameMs\": " << result.percentileFrameMilliseconds(50)
+			<< ", \"p99FrameMs\": " << result.percentileFrameMilliseconds(99)
+			<< ", \"raysPerSecond\": " << uint64_t(result.raysPerSecond())
+			<< ", \"trianglesPerSecond\": " << uint64_t(result.trianglesPerSecond())
+			<< ", \"nodeVisitsPerRay\": " << result.rayStats.nodeVisits / rays
+			<< ", \"triangleTestsPerRay\": " << result.rayStats.triangleTests / rays
+			<< ", \"nodesCulledPercent\": " << result.occlusionStats.nodesCulledPercent()
+			<< ", \"trianglesCulledPercent\": " << result.occlusionStats.trianglesCulledPercent()
+			<< ", \"peakRssKb\": " << result.peakRssKilobytes << "}"
+			<< (i+1 < results.size() ? "," : "") << "\n";
+	}
+	os << "\t],\n\t\"peakRssKb\": " << peakRssKilobytes() << "\n}\n";
+}
+
+namespace {
+	// the text of a "key": value field within a line of our own JSON, or "" if the line doesn't have it
+	std::string findField(const std::string &line, const std::string &key) {
+		size_t keyStart = line.find("\"" + key + "\":");
+		if (keyStart == std::string::npos) return "";
+		size_t valueStart = line.find_first_not_of(" \"", keyStart + key.size() + 3);
+		size_t valueEnd = line.find_first_of(",\"}", valueStart);
+		return line.substr(valueStart, valueEnd - valueStart);
+	}
+}
+
+std::map<std::string, double> readBenchBaseline(const std::string &fileName) {
+	std::ifstream file(fileName);
+	if (!file) throw std::invalid_argument("Could not open baseline `" + fileName + "`");
+	std::map<std::string, double> medians;
+	std::string line;
+	while (std::getline(file, line)) {
+		std::string name = findField(line, "name");
+		std::string median = findField(line, "medianFrameMs");
+		if (!name.empty() && !median.empty()) medians[name] = std::stod(median);
+	}
+	return medians;
+}
+
+bool compareWithBaseline(const std::vector<BenchResult> &results, const std::map<std::string, double> &baseline,
+		double tolerance, std::ostream &os) {
+	bool passed = true;
+	for (const BenchResult &result : results) {
+		auto baselineMedian = baseline.find(result.name);
+		if (baselineMedian == baseline.end()) {
+			os << result.name << ": not in baseline" << std::endl;
+			continue;
+		}
+		double median = result.percentileFrameMilliseconds(50);
+		double change = median / baselineMedian->second - 1;
+		bool regressed = change > tolerance;
+		passed = passed && !regressed;
+		os << result.name << ": " << baselineMedian->second << " ms -> " << median << " ms ("
+			<< (change >= 0 ? "+" : "") << change * 100 << "%)" << (regressed ? " REGRESSION" : "") << std::endl;
+	}
+	return passed;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "DepthPyramid.h"
+#include "RayStats.h"
+
+// Results of running one benchmark scenario (a scene, render mode and camera path) for a fixed number of frames
+struct BenchResult {
+	std::string name;
+	size_t triangles{};  // in the scene
+	std::vector<double> frameMilliseconds;
+	RayStats rayStats;  // over all the frames
+	OcclusionStats occlusionStats;  // over all the frames
+	long peakRssKilobytes{};  // of the whole process once the scenario had finished
+
+	BenchResult();
+	BenchResult(std::string n, size_t triangleCount);
+	double totalSeconds() const;
+	// nearest-rank percentile, e.g. 50 for the median
+	double percentileFrameMilliseconds(double percentile) const;
+	double raysPerSecond() const;
+	// scene triangles rendered per second, so the same measure whichever renderer is used
+	double trianglesPerSecond() const;
+};
+
+// most memory the process has held at once so far, or 0 where the platform can't say
+long peakRssKilobytes();
+void writeBenchJson(std::ostream &os, const std::vector<BenchResult> &results);
+// median frame times by scenario name from JSON written by writeBenchJson
+std::map<std::string, double> readBenchBaseline(const std::string &fileName);
+// Prints how each scenario's median frame time compares with the baseline. Returns false if any got slower by more
+// than the tolerance (a fraction of the baseline time).
+bool compareWithBaseline(const std::vector<BenchResult> &results, const std::map<std::string, double> &baseline,
+	double tolerance, std::ostream &os);
@@ -0,0 +1,353 @@
+#include "Bvh.h"
+#include <algorithm>
+
+#define BVH_BINS 16
+
+Aabb::Aabb() = default;
+Aabb::Aabb(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) : min(boundsMin), max(boundsMax) {}
+
+void Aabb::grow(const glm::vec3 &point) {
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void Aabb::grow(const Aabb &other) {
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+bool Aabb::isEmpty() const {
+	return min.x > max.x;
+}
+
+float Aabb::surfaceArea() const {
+	if (isEmpty()) return 0;
+	glm::vec3 extent = max - min;
+	return 2 * (extent.x*extent.y + extent.y*extent.z + extent.z*extent.x);
+}
+
+glm::vec3 Aabb::centre() const {
+	return (min + max) * 0.5f;
+}
+
+float Aabb::rayEntryDistance(const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance) const {
+	// slab test: where the ray crosses each pair of parallel faces. It enters by the minimum faces along axes it goes
+	// up and by the maximum faces along axes it goes down.
+	float entry = 0;
+	float exit = maxDistance;
+	for (int axis = 0; axis < 3; axis++) {
+		bool isDown = inverseDirection[axis] < 0;
+		float entryDistance = ((isDown ? max[axis] : min[axis]) - origin[axis]) * inverseDirection[axis];
+		float exitDistance = ((isDown ? min[axis] : max[axis]) - origin[axis]) * inverseDirection[axis];
+		if (entryDistance > entry) entry = entryDistance;
+		if (exitDistance < exit) exit = exitDistance;
+	}
+	return entry <= exit ? entry : FLT_MAX;
+}
+
+std::ostream &operator<<(std::ostream &os, const Aabb &box) {
+	os << "[(" << box.min.x << ", " << box.min.y << ", " << box.min.z << "), ("
+	   << box.max.x << ", " << box.max.y << ", " << box.max.z << ")]";
+	return os;
+}
+
+bool BvhNode::isLeaf() const {
+	return triangleCount > 0;
+}
+
+namespace {
+	glm::vec3 triangleCentroid(const ModelTriangle &triangle) {
+		return (triangle.vertices[0] + triangle.vertices[1] + triangle.vertices[2]) / 3.0f;
+	}
+
+	std::vector<glm::vec3> triangleCentroids(const std::vector<ModelTriangle> &triangles) {
+		std::vector<glm::vec3> centroids(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i++) centroids[i] = triangleCentroid(triangles[i]);
+		return centroids;
+	}
+}
+
+std::vector<Aabb> triangleBounds(const std::vector<ModelTriangle> &triangles) {
+	std::vector<Aabb> bounds(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++) {
+		for (const glm::vec3 &vertex : triangles[i].vertices) bounds[i].grow(vertex);
+	}
+	return bounds;
+}
+
+Bvh::Bvh() = default;
+
+Bvh::Bvh(const std::vector<ModelTriangle> &triangles) : Bvh(triangleBounds(triangles), triangleCentroids(triangles)) {}
+
+Bvh::Bvh(const std::vector<Aabb> &primitiveBounds, const std::vector<glm::vec3> &centroids) {
+	if (primitiveBounds.empty()) return;
+
+	triangleIndices.resize(primitiveBounds.size());
+	for (size_t i = 0; i < primitiveBounds.size(); i++) triangleIndices[i] = i;
+
+	nodes.reserve(2*primitiveBounds.size());
+	BvhNode root;
+	root.leftChildOrFirstTriangle = 0;
+	root.triangleCount = primitiveBounds.size();
+	updateBounds(root, primitiveBounds);
+	nodes.push_back(root);
+	subdivide(0, 0, centroids, primitiveBounds);
+	builtCosts = subtreeCosts();
+}
+
+// Splits a leaf depth levels below the root, and then its children and so on, until the surface area heuristic says
+// it's no longer worth it or they reach BVH_MAX_DEPTH. The new nodes go on the end.
+void Bvh::subdivide(uint32_t leaf, uint32_t depth, const std::vector<glm::vec3> &centroids,
+		const std::vector<Aabb> &primitiveBounds) {
+	std::vector<std::pair<uint32_t, uint32_t>> stack = {std::make_pair(leaf, depth)};
+	while (!stack.empty()) {
+		uint32_t nodeIndex = stack.back().first;
+		uint32_t nodeDepth = stack.back().second;
+		stack.pop_back();
+
+		int axis;
+		float position;
+		if (nodeDepth >= BVH_MAX_DEPTH) continue;
+		if (!findBestSplit(nodes[nodeIndex], centroids, primitiveBounds, axis, position)) continue;
+
+		uint32_t first = nodes[nodeIndex].leftChildOrFirstTriangle;
+		uint32_t count = nodes[nodeIndex].triangleCount;
+		auto middle = std::partition(triangleIndices.begin() + first, triangleIndices.begin() + first + count,
+			[&](uint32_t i) { return centroids[i][axis] < position; });
+		uint32_t leftCount = middle - (triangleIndices.begin() + first);
+		if (leftCount == 0 || leftCount == count) continue;
+
+		BvhNode left;
+		left.leftChildOrFirstTriangle = first;
+		left.triangleCount = leftCount;
+		updateBounds(left, primitiveBounds);
+		BvhNode right;
+		right.leftChildOrFirstTriangle = first + leftCount;
+		right.triangleCount = count - leftCount;
+		updateBounds(right, primitiveBounds);
+
+		uint32_t leftIndex = nodes.size();
+		nodes.push_back(left);
+		nodes.push_back(right);
+		nodes[nodeIndex].leftChildOrFirstTriangle = leftIndex;
+		nodes[nodeIndex].triangleCount = 0;
+		stack.push_back(std::make_pair(leftIndex + 1, nodeDepth + 1));
+		stack.push_back(std::make_pair(leftIndex, nodeDepth + 1));
+	}
+}
+
+std::vector<float> Bvh::subtreeCosts() const {
+	// children come after their parents, so going backwards reaches every child before its parent
+	std::vector<float> costs(nodes.size());
+	for (size_t i = nodes.size(); i-- > 0;) {
+		const BvhNode &node = nodes[i];
+		float area = node.bounds.surfaceArea();
+		if (node.isLeaf()) {
+			costs[i] = node.triangleCount * area;
+		} else {
+			costs[i] = BVH_TRAVERSAL_COST*area + costs[node.leftChildOrFirstTriangle] +
+				costs[node.leftChildOrFirstTriangle + 1];
+		}
+	}
+	return costs;
+}
+
+void Bvh::refit(const std::vector<ModelTriangle> &triangles) {
+	refit(triangleBounds(triangles));
+}
+
+void Bvh::refit(const std::vector<Aabb> &primitiveBounds) {
+	for (size_t i = nodes.size(); i-- > 0;) {
+		BvhNode &node = nodes[i];
+		if (node.isLeaf()) {
+			updateBounds(node, primitiveBounds);
+		} else {
+			node.bounds = nodes[node.leftChildOrFirstTriangle].bounds;
+			node.bounds.grow(nodes[node.leftChildOrFirstTriangle + 1].bounds);
+		}
+	}
+}
+
+BvhUpdateStats Bvh::update(const std::vector<ModelTriangle> &triangles, float rebuildRatio) {
+	return update(triangles, triangleBounds(triangles), rebuildRatio);
+}
+
+BvhUpdateStats Bvh::update(const std::vector<ModelTriangle> &triangles, const std::vector<Aabb> &primitiveBounds,
+		float rebuildRatio) {
+	BvhUpdateStats stats{0, 0, false};
+	if (nodes.empty()) return stats;
+	refit(primitiveBounds);
+	std::vector<float> costs = subtreeCosts();
+	if (costs[0] > rebuildRatio * builtCosts[0]) {
+		*this = Bvh(triangles);
+		return BvhUpdateStats{1, triangles.size(), true};
+	}
+
+	// the highest subtrees that have got too slow, with their depths; below a subtree that hasn't, one further down
+	// might have
+	std::vector<std::pair<uint32_t, uint32_t>> degraded;
+	std::vector<std::pair<uint32_t, uint32_t>> stack = {std::make_pair(0u, 0u)};
+	while (!stack.empty()) {
+		uint32_t nodeIndex = stack.back().first;
+		uint32_t depth = stack.back().second;
+		stack.pop_back();
+		const BvhNode &node = nodes[nodeIndex];
+		if (costs[nodeIndex] > rebuildRatio * builtCosts[nodeIndex]) {
+			degraded.push_back(std::make_pair(nodeIndex, depth));
+		} else if (!node.isLeaf()) {
+			stack.push_back(std::make_pair(node.leftChildOrFirstTriangle + 1, depth + 1));
+			stack.push_back(std::make_pair(node.leftChildOrFirstTriangle, depth + 1));
+		}
+	}
+	if (degraded.empty()) return stats;
+
+	std::vector<glm::vec3> centroids(triangles.size());
+	size_t oldNodeCount = nodes.size();
+	for (const std::pair<uint32_t, uint32_t> &subtree : degraded) {
+		uint32_t nodeIndex = subtree.first;
+		// the subtree's triangles run from its leftmost leaf's first to its rightmost leaf's last
+		uint32_t leftmost = nodeIndex;
+		uint32_t rightmost = nodeIndex;
+		while (!nodes[leftmost].isLeaf()) leftmost = nodes[leftmost].leftChildOrFirstTriangle;
+		while (!nodes[rightmost].isLeaf()) rightmost = nodes[rightmost].leftChildOrFirstTriangle + 1;
+		uint32_t first = nodes[leftmost].leftChildOrFirstTriangle;
+		uint32_t count = nodes[rightmost].leftChildOrFirstTriangle + nodes[rightmost].triangleCount - first;
+		for (uint32_t i = first; i < first + count; i++) {
+			centroids[triangleIndices[i]] = triangleCentroid(triangles[triangleIndices[i]]);
+		}
+
+		// its old nodes are left behind, unreachable, until compact
+		nodes[nodeIndex].leftChildOrFirstTriangle = first;
+		nodes[nodeIndex].triangleCount = count;
+		subdivide(nodeIndex, subtree.second, centroids, primitiveBounds);
+		stats.subtreesRebuilt++;
+		stats.trianglesRebuilt += count;
+	}
+
+	costs = subtreeCosts();
+	builtCosts.resize(nodes.size());
+	for (const std::pair<uint32_t, uint32_t> &subtree : degraded) builtCosts[subtree.first] = costs[subtree.first];
+	for (size_t i = oldNodeCount; i < nodes.size(); i++) builtCosts[i] = costs[i];
+	compact();
+	return stats;
+}
+
+// Copies the nodes still reachable from the root into a new list in depth-first order, as the builder leaves them
+void Bvh::compact() {
+	std::vector<BvhNode> kept = {nodes[0]};
+	std::vector<float> keptCosts = {builtCosts[0]};
+	std::vector<uint32_t> stack = {0};
+	while (!stack.empty()) {
+		uint32_t nodeIndex = stack.back();
+		stack.pop_back();
+		if (kept[nodeIndex].isLeaf()) continue;
+		uint32_t oldLeft = kept[nodeIndex].leftChildOrFirstTriangle;
+		uint32_t newLeft = kept.size();
+		kept[nodeIndex].leftChildOrFirstTriangle = newLeft;
+		for (uint32_t child = oldLeft; child < oldLeft + 2; child++) {
+			kept.push_back(nodes[child]);
+			keptCosts.push_back(builtCosts[child]);
+		}
+		stack.push_back(newLeft + 1);
+		stack.push_back(newLeft);
+	}
+	nodes.swap(kept);
+	builtCosts.swap(keptCosts);
+}
+
+void Bvh::updateBounds(BvhNode &node, const std::vector<Aabb> &primitiveBounds) const {
+	node.bounds = Aabb();
+	for (uint32_t i = 0; i < node.triangleCount; i++) {
+		node.bounds.grow(primitiveBounds[triangleIndices[node.leftChildOrFirstTriangle + i]]);
+	}
+}
+
+// Bins the node's triangle centroids along each axis and finds the plane with the lowest surface area heuristic
+// cost. Returns false if keeping the node as a leaf is cheaper than any split.
+bool Bvh::findBestSplit(const BvhNode &node, const std::vector<glm::vec3> &centroids,
+		const std::vector<Aabb> &primitiveBounds, int &axis, float &position) const {
+	if (node.triangleCount < 2) return false;
+
+	Aabb centroidBounds;
+	for (uint32_t i = 0; i < node.triangleCount; i++) {
+		centroidBounds.grow(centroids[triangleIndices[node.leftChildOrFirstTriangle + i]]);
+	}
+
+	float bestCost = FLT_MAX;
+	for (int a = 0; a < 3; a++) {
+		float extent = centroidBounds.max[a] - centroidBounds.min[a];
+		if (extent <= 0) continue;
+
+		Aabb binBounds[BVH_BINS];
+		uint32_t binCounts[BVH_BINS] = {};
+		float binsPerUnit = BVH_BINS / extent;
+		for (uint32_t i = 0; i < node.triangleCount; i++) {
+			uint32_t triangleIndex = triangleIndices[node.leftChildOrFirstTriangle + i];
+			int bin = std::min(BVH_BINS - 1, int((centroids[triangleIndex][a] - centroidBounds.min[a]) * binsPerUnit));
+			binCounts[bin]++;
+			binBounds[bin].grow(primitiveBounds[triangleIndex]);
+		}
+
+		// sweep from both ends to get the area and count either side of each of the planes between bins
+		float leftAreas[BVH_BINS - 1], rightAreas[BVH_BINS - 1];
+		uint32_t leftCounts[BVH_BINS - 1], rightCounts[BVH_BINS - 1];
+		Aabb leftBox, rightBox;
+		uint32_t leftSum = 0, rightSum = 0;
+		for (int i = 0; i < BVH_BINS - 1; i++) {
+			leftSum += binCounts[i];
+			leftCounts[i] = leftSum;
+			leftBox.grow(binBounds[i]);
+			leftAreas[i] = leftBox.surfaceArea();
+			rightSum += binCounts[BVH_BINS - 1 - i];
+			rightCounts[BVH_BINS - 2 - i] = rightSum;
+			rightBox.grow(binBounds[BVH_BINS - 1 - i]);
+			rightAreas[BVH_BINS - 2 - i] = rightBox.surfaceArea();
+		}
+		for (int i = 0; i < BVH_BINS - 1; i++) {
+			if (leftCounts[i] == 0 || rightCounts[i] == 0) continue;
+			float cost = leftCounts[i]*leftAreas[i] + rightCounts[i]*rightAreas[i];
+			if (cost < bestCost) {
+				bestCost = cost;
+				axis = a;
+				position = centroidBounds.min[a] + (i + 1) / binsPerUnit;
+			}
+		}
+	}
+
+	float nodeArea = node.bounds.surfaceArea();
+	float leafCost = node.triangleCount * nodeArea;
+	return bestCost + BVH_TRAVERSAL_COST*nodeArea < leafCost;
+}
+
+std::ostream &operator<<(std::ostream &os, const Bvh &bvh) {
+	os << "BVH with " << bvh.nodes.size() << " nodes over " << bvh.triangleIndices.size() << " triangles";
+	return os;
+}
+
+// Tests the triangles of meshTriangles at triangleIndices[first] to triangleIndices[first + count - 1] against the
+// ray. Returns true if one is hit nearer than closestDistance, having set closestDistance and closestIndex to the
+// nearest.
+bool intersectLeafTriangles(const std::vector<uint32_t> &triangleIndices, uint32_t first, uint32_t count,
+		const std::vector<ModelTriangle> &meshTriangles, const glm::vec3 &rayStart, const glm::vec3 &rayDirection,
+		float &closestDistance, int &closestIndex, RayStats &stats) {
+	bool isHit = false;
+	for (uint32_t j = 0; j < count; j++) {
+		uint32_t i = triangleIndices[first + j];
+		const ModelTriangle &triangle = meshTriangles[i];
+		stats.triangleTests++;
+		glm::vec3 e0 = triangle.vertices[1] - triangle.vertices[0];
+		glm::vec3 e1 = triangle.vertices[2] - triangle.vertices[0];
+		glm::vec3 SPVector = rayStart - triangle.vertices[0];
+		glm::mat3 DEMatrix(-rayDirection, e0, e1);
+		glm::vec3 possibleSolution = inverse(DEMatrix) * SPVector;
+		float t = possibleSolution[0];
+		float u = possibleSolution[1];
+		float v = possibleSolution[2];
+		if (t > 0 && u >= 0 && u <= 1 && v >= 0 && v <= 1 && u + v <= 1 && t > 0.001 && t < closestDistance) {
+			closestIndex = i;
+			closestDistance = t;
+			isHit = true;
+		}
+	}
+	return isHit;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+#include "ModelTriangle.h"
+#include "RayStats.h"
+
+#define BVH_TRAVERSAL_COST 1.0f  // cost of visiting a node relative to testing one triangle
+// No node is more than this many levels below the root; the build makes a leaf of whatever reaches it. A walk that
+// keeps one child of each node waiting while it goes down the other never has more than BVH_MAX_DEPTH + 1 nodes on its
+// stack, which is what the traversal stacks are sized for.
+#define BVH_MAX_DEPTH 48
+
+struct Aabb {
+	glm::vec3 min{FLT_MAX};
+	glm::vec3 max{-FLT_MAX};
+
+	Aabb();
+	Aabb(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+	void grow(const glm::vec3 &point);
+	void grow(const Aabb &other);
+	bool isEmpty() const;
+	float surfaceArea() const;
+	glm::vec3 centre() const;
+	// distance along the ray (origin + t*direction) at which it enters the box, or FLT_MAX if it misses the box or only
+	// reaches it beyond maxDistance. Takes slabInverseDirection(direction), which can be worked out once per ray.
+	float rayEntryDistance(const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance) const;
+	friend std::ostream &operator<<(std::ostream &os, const Aabb &box);
+};
+
+// 1/direction for the slab tests, with components too small to invert taken as 1e-30, so that a ray parallel to an
+// axis counts as tilted very slightly up it. Every distance to a face is then finite, which the tests need under
+// -Ofast, whose finite maths assumes infinities and NaNs never happen.
+inline float slabInverse(float component) {
+	return 1.0f / (std::abs(component) < 1e-30f ? 1e-30f : component);
+}
+inline glm::vec3 slabInverseDirection(const glm::vec3 &direction) {
+	return glm::vec3(slabInverse(direction.x), slabInverse(direction.y), slabInverse(direction.z));
+}
+
+struct BvhNode {
+	Aabb bounds;
+	// interior node: index of the left child (the right child is the next node)
+	// leaf: position of the node's first triangle in Bvh::triangleIndices
+	uint32_t leftChildOrFirstTriangle{};
+	uint32_t triangleCount{};  // 0 for interior nodes
+
+	bool isLeaf() const;
+};
+
+// What Bvh::update did
+struct BvhUpdateStats {
+	size_t subtreesRebuilt;
+	size_t trianglesRebuilt;  // under the rebuilt subtrees
+	bool wasFullRebuild;
+};
+
+// Binary bounding volume hierarchy over a triangle list, built top-down with the binned surface area heuristic.
+// The root is node 0, siblings are stored next to each other, and children always come after their parent. Each
+// node's triangles are next to each other in triangleIndices, and so are the triangles of every subtree.
+// It can also be built over other things from their bounding boxes, such as the instances in a two-level scene (see
+// Instancing.h), in which case triangleIndices holds their indices instead.
+class Bvh {
+public:
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> triangleIndices;
+	std::vector<float> builtCosts;  // each node's subtreeCosts when it was last built
+
+	Bvh();
+	explicit Bvh(const std::vector<ModelTriangle> &triangles);
+	// over primitives with these bounds, split by their centroids
+	Bvh(const std::vector<Aabb> &primitiveBounds, const std::vector<glm::vec3> &centroids);
+	// Surface area heuristic cost of each node's subtree: the sum over its nodes of their surface area times the cost
+	// of visiting them (BVH_TRAVERSAL_COST for interior nodes, the triangle count for leaves). The root's divided by
+	// its own area is the expected cost of tracing a ray that hits the scene's bounds.
+	std::vector<float> subtreeCosts() const;
+	// Fits the bounds to the triangles again, bottom-up, after they've moved, without changing the tree. They must be
+	// the same triangles in the same order.
+	void refit(const std::vector<ModelTriangle> &triangles);
+	void refit(const std::vector<Aabb> &primitiveBounds);
+	// Refits, then rebuilds the highest subtrees whose cost has grown to more than rebuildRatio times what it was when
+	// they were built, which is the whole tree if the root's has
+	BvhUpdateStats update(const std::vector<ModelTriangle> &triangles, float rebuildRatio);
+	// the same, with the triangles' bounds (from triangleBounds) already worked out
+	BvhUpdateStats update(const std::vector<ModelTriangle> &triangles, const std::vector<Aabb> &primitiveBounds,
+		float rebuildRatio);
+	friend std::ostream &operator<<(std::ostream &os, const Bvh &bvh);
+
+private:
+	void updateBounds(BvhNode &node, const std::vector<Aabb> &primitiveBounds) const;
+	bool findBestSplit(const BvhNode &node, const std::vector<glm::vec3> &centroids,
+		const std::vector<Aabb> &primitiveBounds, int &axis, float &position) const;
+	void subdivide(uint32_t nodeIndex, uint32_t depth, const std::vector<glm::vec3> &centroids,
+		const std::vector<Aabb> &primitiveBounds);
+	void compact();
+};
+
+std::ostream &operator<<(std::ostream &os, const Bvh &bvh);
+// bounding box of each triangle, by index
+std::vector<Aabb> triangleBounds(const std::vector<ModelTriangle> &triangles);
+
+// Tests the triangles of meshTriangles at triangleIndices[first] to triangleIndices[first + count - 1] against the
+// ray. Returns true if one is hit nearer than closestDistance, having set closestDistance and closestIndex to the
+// nearest.
+bool intersectLeafTriangles(const std::vector<uint32_t> &triangleIndices, uint32_t first, uint32_t count,
+	const std::vector<ModelTriangle> &meshTriangles, const glm::vec3 &rayStart, const glm::vec3 &rayDirection,
+	float &closestDistance, int &closestIndex, RayStats &stats);
+
+// Walks the subtree of a BVH under root nearest child first, handing each leaf whose box the ray enters within
+// closestDistance to visitLeaf(node, closestDistance), which tests what's in it and shortens closestDistance when it
+// finds something nearer. Boxes beyond the nearest hit so far are skipped.
+template <typename VisitLeaf>
+void traverseBvh(const Bvh &bvh, uint32_t root, const glm::vec3 &rayStart, const glm::vec3 &rayDirection,
+		float &closestDistance, RayStats &stats, VisitLeaf visitLeaf) {
+	if (bvh.nodes.empty()) return;
+	// a local copy can stay in a register, where the caller's might have to be reloaded after every store
+	float nearest = closestDistance;
+	glm::vec3 inverseDirection = slabInverseDirection(rayDirection);
+	std::array<uint32_t, BVH_MAX_DEPTH + 1> stack;
+	size_t stackSize = 0;
+	if (bvh.nodes[root].bounds.rayEntryDistance(rayStart, inverseDirection, nearest) != FLT_MAX) {
+		stack[stackSize++] = root;
+	}
+	while (stackSize > 0) {
+		const BvhNode &node = bvh.nodes[stack[--stackSize]];
+		stats.nodeVisits++;
+
+		if (node.isLeaf()) {
+			visitLeaf(node, nearest);
+			continue;
+		}
+
+		// push the further child first so the nearer one is visited next
+		uint32_t left = node.leftChildOrFirstTriangle;
+		float leftDistance = bvh.nodes[left].bounds.rayEntryDistance(rayStart, inverseDirection, nearest);
+		float rightDistance = bvh.nodes[left+1].bounds.rayEntryDistance(rayStart, inverseDirection, nearest);
+		uint32_t nearChild = leftDistance <= rightDistance ? left : left+1;
+		float farDistance = std::max(leftDistance, rightDistance);
+		if (farDistance != FLT_MAX) stack[stackSize++] = nearChild == left ? left+1 : left;
+		if (std::min(leftDistance, rightDistance) != FLT_MAX) stack[stackSize++] = nearChild;
+	}
+	closestDistance = nearest;
+}
+
+// the same over the whole tree
+template <typename VisitLeaf>
+void traverseBvh(const Bvh &bvh, const glm::vec3 &rayStart, const glm::vec3 &rayDirection, float &closestDistance,
+		RayStats &stats, VisitLeaf visitLeaf) {
+	traverseBvh(bvh, 0, rayStart, rayDirection, closestDistance, stats, visitLeaf);
+}
@@ -0,0 +1,110 @@
+#include "DepthPyramid.h"
+#include <algorithm>
+#include <climits>
+
+DepthPyramid::DepthPyramid() = default;
+
+DepthPyramid::DepthPyramid(size_t width, size_t height) :
+		dirtyMinX(INT_MAX), dirtyMinY(INT_MAX), dirtyMaxX(INT_MIN), dirtyMaxY(INT_MIN) {
+	while (true) {
+		widths.push_back(width);
+		heights.push_back(height);
+		levels.push_back(std::vector<float>(width * height, 0));
+		if (width == 1 && height == 1) break;
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+}
+
+void DepthPyramid::clear() {
+	for (std::vector<float> &level : levels) std::fill(level.begin(), level.end(), 0);
+	dirtyMinX = dirtyMinY = INT_MAX;
+	dirtyMaxX = dirtyMaxY = INT_MIN;
+}
+
+void DepthPyramid::markDirty(int minX, int minY, int maxX, int maxY) {
+	dirtyMinX = std::min(dirtyMinX, minX);
+	dirtyMinY = std::min(dirtyMinY, minY);
+	dirtyMaxX = std::max(dirtyMaxX, maxX);
+	dirtyMaxY = std::max(dirtyMaxY, maxY);
+}
+
+// Copies the dirty region of the full resolution inverse depth buffer in and rebuilds the texels above it.
+// The depth buffer only ever gets nearer during a frame, so a pyramid that is behind on updates is still
+// conservative; updating in batches just means fewer things get culled.
+void DepthPyramid::update(const float *inverseDepths) {
+	int minX = std::max(dirtyMinX, 0);
+	int minY = std::max(dirtyMinY, 0);
+	int maxX = std::min(dirtyMaxX, int(widths[0]) - 1);
+	int maxY = std::min(dirtyMaxY, int(heights[0]) - 1);
+	dirtyMinX = dirtyMinY = INT_MAX;
+	dirtyMaxX = dirtyMaxY = INT_MIN;
+	if (minX > maxX || minY > maxY) return;
+
+	for (int y = minY; y <= maxY; y++) {
+		std::copy(inverseDepths + y*widths[0] + minX, inverseDepths + y*widths[0] + maxX + 1,
+			levels[0].begin() + y*widths[0] + minX);
+	}
+
+	for (size_t level = 1; level < levels.size(); level++) {
+		minX /= 2;
+		minY /= 2;
+		maxX /= 2;
+		maxY /= 2;
+		const std::vector<float> &below = levels[level - 1];
+		size_t belowWidth = widths[level - 1];
+		size_t belowHeight = heights[level - 1];
+		for (int y = minY; y <= maxY; y++) {
+			for (int x = minX; x <= maxX; x++) {
+				size_t x0 = 2*x, y0 = 2*y;
+				size_t x1 = std::min(x0 + 1, belowWidth - 1), y1 = std::min(y0 + 1, belowHeight - 1);
+				levels[level][y*widths[level] + x] = std::min(
+					std::min(below[y0*belowWidth + x0], below[y0*belowWidth + x1]),
+					std::min(below[y1*belowWidth + x0], below[y1*belowWidth + x1]));
+			}
+		}
+	}
+}
+
+// True if everything in the given pixel rectangle is already nearer than nearestInverseDepth
+bool DepthPyramid::isOccluded(int minX, int minY, int maxX, int maxY, float nearestInverseDepth) const {
+	minX = std::max(minX, 0);
+	minY = std::max(minY, 0);
+	maxX = std::min(maxX, int(widths[0]) - 1);
+	maxY = std::min(maxY, int(heights[0]) - 1);
+	if (minX > maxX || minY > maxY) return true;
+
+	// go up until the rectangle covers at most 2x2 texels, so the test is a handful of reads whatever its size
+	size_t level = 0;
+	while (maxX - minX > 1 || maxY - minY > 1) {
+		minX /= 2;
+		minY /= 2;
+		maxX /= 2;
+		maxY /= 2;
+		level++;
+	}
+
+	const std::vector<float> &texels = levels[level];
+	float farthest = texels[minY*widths[level] + minX];
+	farthest = std::min(farthest, texels[minY*widths[level] + maxX]);
+	farthest = std::min(farthest, texels[maxY*widths[level] + minX]);
+	farthest = std::min(farthest, texels[maxY*widths[level] + maxX]);
+	return nearestInverseDepth < farthest;
+}
+
+double OcclusionStats::nodesCulledPercent() const {
+	return nodesTested == 0 ? 0 : 100.0 * nodesCulled / nodesTested;
+}
+
+double OcclusionStats::trianglesCulledPercent() const {
+	return trianglesTested == 0 ? 0 : 100.0 * trianglesCulled / trianglesTested;
+}
+
+OcclusionStats &OcclusionStats::operator+=(const OcclusionStats &other) {
+	nodesTested += other.nodesTested;
+	nodesCulled += other.nodesCulled;
+	trianglesTested += other.trianglesTested;
+	trianglesCulled += other.trianglesCulled;
+	trianglesDrawn += other.trianglesDrawn;
+	return *this;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Hierarchical Z-buffer over an inverse depth buffer (1/depth, 0 where nothing has been drawn). Each texel of a level
+// holds the smallest inverse depth of the 2x2 texels below it, i.e. the farthest depth drawn anywhere in its block, so
+// anything whose nearest point is farther than that is hidden behind what has already been drawn.
+class DepthPyramid {
+public:
+	std::vector<size_t> widths;
+	std::vector<size_t> heights;
+	std::vector<std::vector<float>> levels;  // levels[0] is full resolution
+	// region of the depth buffer drawn to since the last update
+	int dirtyMinX, dirtyMinY, dirtyMaxX, dirtyMaxY;
+
+	DepthPyramid();
+	DepthPyramid(size_t width, size_t height);
+	void clear();
+	void markDirty(int minX, int minY, int maxX, int maxY);
+	void update(const float *inverseDepths);
+	bool isOccluded(int minX, int minY, int maxX, int maxY, float nearestInverseDepth) const;
+};
+
+// What the hierarchical depth test rejected while rasterising: BVH nodes and instances, and triangles. The triangles
+// under a culled node or instance count as tested and culled along with it.
+struct OcclusionStats {
+	uint64_t nodesTested{};  // including instances
+	uint64_t nodesCulled{};
+	uint64_t trianglesTested{};
+	uint64_t trianglesCulled{};
+	uint64_t trianglesDrawn{};
+
+	// of those tested, or 0 if none were
+	double nodesCulledPercent() const;
+	double trianglesCulledPercent() const;
+	OcclusionStats &operator+=(const OcclusionStats &other);
+};
@@ -0,0 +1,191 @@
+#include "EnvironmentMap.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+	glm::vec3 unpackTexel(uint32_t colour) {
+		return glm::vec3((colour >> 16) & 255, (colour >> 8) & 255, colour & 255);
+	}
+
+	float luminance(const glm::vec3 &colour) {
+		return glm::dot(colour, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+
+	// latitude-longitude texture coordinates (0 to 1) of a direction, and back
+	glm::vec2 directionToUv(const glm::vec3 &direction) {
+		float u = 0.5f + std::atan2(direction.x, -direction.z) / float(2*M_PI);
+		float v = std::acos(glm::clamp(direction.y, -1.0f, 1.0f)) / float(M_PI);
+		return glm::vec2(u, v);
+	}
+
+	glm::vec3 uvToDirection(float u, float v) {
+		float longitude = (u - 0.5f) * float(2*M_PI);
+		float latitude = v * float(M_PI);
+		float sinLatitude = std::sin(latitude);
+		return glm::vec3(sinLatitude*std::sin(longitude), std::cos(latitude), -sinLatitude*std::cos(longitude));
+	}
+
+	// The texel of a horizontal cross image that a direction points at
+	glm::vec3 cubeCrossTexel(const TextureMap &image, const glm::vec3 &d) {
+		size_t faceSize = image.width / 4;
+		glm::vec3 a = glm::abs(d);
+		int column;
+		int row;
+		float s;
+		float t;
+		if (a.x >= a.y && a.x >= a.z) {
+			column = d.x > 0 ? 2 : 0;
+			row = 1;
+			s = (d.x > 0 ? d.z : -d.z) / a.x;
+			t = -d.y / a.x;
+		} else if (a.y >= a.z) {
+			column = 1;
+			row = d.y > 0 ? 0 : 2;
+			s = d.x / a.y;
+			t = d.y > 0 ? -d.z / a.y : d.z / a.y;
+		} else {
+			column = d.z > 0 ? 3 : 1;
+			row = 1;
+			s = (d.z > 0 ? -d.x : d.x) / a.z;
+			t = -d.y / a.z;
+		}
+		size_t x = std::min(size_t((s + 1) / 2 * faceSize), faceSize - 1) + column*faceSize;
+		size_t y = std::min(size_t((t + 1) / 2 * faceSize), faceSize - 1) + row*faceSize;
+		return unpackTexel(image.pixels[y*image.width + x]);
+	}
+}
+
+glm::vec3 EnvironmentMap::Level::bilinear(float u, float v) const {
+	float x = u*width - 0.5f;
+	float y = glm::clamp(v*height - 0.5f, 0.0f, float(height - 1));
+	int x0 = int(std::floor(x));
+	int y0 = int(y);
+	float fx = x - x0;
+	float fy = y - y0;
+	// wrap around in longitude, clamp in latitude
+	size_t left = (x0 % int(width) + width) % width;
+	size_t right = (left + 1) % width;
+	size_t top = y0;
+	size_t bottom = std::min(size_t(y0 + 1), height - 1);
+	glm::vec3 upper = glm::mix(texels[top*width + left], texels[top*width + right], fx);
+	glm::vec3 lower = glm::mix(texels[bottom*width + left], texels[bottom*width + right], fx);
+	return glm::mix(upper, lower, fy);
+}
+
+EnvironmentMap::EnvironmentMap() = default;
+EnvironmentMap::EnvironmentMap(const TextureMap &image, EnvironmentLayout layout) {
+	Level base;
+	if (layout == EQUIRECTANGULAR) {
+		base.width = image.width;
+		base.height = image.height;
+		for (uint32_t pixel : image.pixels) base.texels.push_back(unpackTexel(pixel));
+	} else {
+		if (image.width % 4 != 0 || image.width / 4 * 3 != image.height) {
+			throw std::invalid_argument("A cube cross environment map must be 4:3 with square faces");
+		}
+		base.width = image.width;
+		base.height = image.width / 2;
+		for (size_t y = 0; y < base.height; y++) {
+			for (size_t x = 0; x < base.width; x++) {
+				glm::vec3 direction = uvToDirection((x + 0.5f) / base.width, (y + 0.5f) / base.height);
+				base.texels.push_back(cubeCrossTexel(image, direction));
+			}
+		}
+	}
+	levels.push_back(base);
+	buildMips();
+	buildCdf();
+}
+
+bool EnvironmentMap::isLoaded() const {
+	return !levels.empty();
+}
+
+// Each mip is half the size of the one before, averaging 2x2 texels, then blurred with a 1-2-1 tent across so that
+// the blur grows smoothly from level to level
+void EnvironmentMap::buildMips() {
+	while (levels.back().width > 8 && levels.back().height > 4) {
+		const Level &previous = levels.back();
+		Level level;
+		level.width = previous.width / 2;
+		level.height = previous.height / 2;
+		std::vector<glm::vec3> averaged(level.width * level.height);
+		for (size_t y = 0; y < level.height; y++) {
+			for (size_t x = 0; x < level.width; x++) {
+				const glm::vec3 *row = &previous.texels[2*y*previous.width];
+				averaged[y*level.width + x] = (row[2*x] + row[2*x + 1] + row[previous.width + 2*x] +
+					row[previous.width + 2*x + 1]) / 4.0f;
+			}
+		}
+		level.texels.resize(averaged.size());
+		for (size_t y = 0; y < level.height; y++) {
+			for (size_t x = 0; x < level.width; x++) {
+				size_t left = (x + level.width - 1) % level.width;
+				size_t right = (x + 1) % level.width;
+				const glm::vec3 *row = &averaged[y*level.width];
+				level.texels[y*level.width + x] = (row[left] + 2.0f*row[x] + row[right]) / 4.0f;
+			}
+		}
+		levels.push_back(level);
+	}
+}
+
+// A texel's luminance times the solid angle it covers, which shrinks towards the poles. A floor keeps black areas
+// sampleable, so that estimates using the samples stay unbiased.
+float EnvironmentMap::texelWeight(size_t x, size_t y) const {
+	const Level &base = levels[0];
+	float sinLatitude = std::sin((y + 0.5f) / base.height * float(M_PI));
+	return (luminance(base.texels[y*base.width + x]) + 1e-3f) * sinLatitude;
+}
+
+void EnvironmentMap::buildCdf() {
+	const Level &base = levels[0];
+	rowCdf.assign(base.height + 1, 0);
+	columnCdfs.assign(base.height * (base.width + 1), 0);
+	for (size_t y = 0; y < base.height; y++) {
+		float *columnCdf = &columnCdfs[y * (base.width + 1)];
+		for (size_t x = 0; x < base.width; x++) columnCdf[x+1] = columnCdf[x] + texelWeight(x, y);
+		rowCdf[y+1] = rowCdf[y] + columnCdf[base.width];
+		for (size_t x = 1; x <= base.width; x++) columnCdf[x] /= std::max(columnCdf[base.width], 1e-20f);
+	}
+	totalWeight = rowCdf[base.height];
+	for (float &value : rowCdf) value /= totalWeight;
+}
+
+glm::vec3 EnvironmentMap::lookup(const glm::vec3 &direction, float roughness) const {
+	glm::vec2 uv = directionToUv(direction);
+	float level = glm::clamp(roughness, 0.0f, 1.0f) * (levels.size() - 1);
+	size_t lower = size_t(level);
+	if (lower + 1 >= levels.size()) return levels[lower].bilinear(uv.x, uv.y);
+	return glm::mix(levels[lower].bilinear(uv.x, uv.y), levels[lower+1].bilinear(uv.x, uv.y), level - lower);
+}
+
+glm::vec3 EnvironmentMap::sampleDirection(float u1, float u2, float &pdf) const {
+	const Level &base = levels[0];
+	// pick a row, then a column within it, then a point within the texel
+	size_t y = std::upper_bound(rowCdf.begin(), rowCdf.end(), u1) - rowCdf.begin();
+	y = std::min(y, base.height) - 1;
+	const float *columnCdf = &columnCdfs[y * (base.width + 1)];
+	size_t x = std::upper_bound(columnCdf, columnCdf + base.width + 1, u2) - columnCdf;
+	x = std::min(x, base.width) - 1;
+	float rowWidth = rowCdf[y+1] - rowCdf[y];
+	float columnWidth = columnCdf[x+1] - columnCdf[x];
+	float v = (y + (rowWidth > 0 ? (u1 - rowCdf[y]) / rowWidth : 0.5f)) / base.height;
+	float u = (x + (columnWidth > 0 ? (u2 - columnCdf[x]) / columnWidth : 0.5f)) / base.width;
+	glm::vec3 direction = uvToDirection(u, v);
+	pdf = this->pdf(direction);
+	return direction;
+}
+
+float EnvironmentMap::pdf(const glm::vec3 &direction) const {
+	const Level &base = levels[0];
+	glm::vec2 uv = directionToUv(direction);
+	size_t x = std::min(size_t(uv.x * base.width), base.width - 1);
+	size_t y = std::min(size_t(uv.y * base.height), base.height - 1);
+	float weight = texelWeight(x, y);
+	// the texel's probability is spread evenly over its area in u and v, and a small area there covers
+	// 2pi^2 sin(latitude) times as much solid angle
+	float sinLatitude = std::max(std::sin(uv.y * float(M_PI)), 1e-6f);
+	return weight / totalWeight * base.width * base.height / (float(2*M_PI*M_PI) * sinLatitude);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "TextureMap.h"
+
+// How the six faces or the sphere of directions are laid out in an environment image
+enum EnvironmentLayout {
+	EQUIRECTANGULAR,  // 2:1, longitude across (-z in the middle) and latitude down (+y at the top)
+	CUBE_CROSS  // 4:3 horizontal cross: +y above -z, then -x, -z, +x, +z across the middle, and -y below -z
+};
+
+// A picture of everything far away, looked up by direction, for rays that miss the scene and for image-based
+// lighting. Either layout is resampled into a latitude-longitude grid, with a chain of half-size, blurred copies
+// (mips) for glossy lookups and a luminance CDF for importance sampling. Colours are 0 to 255 per channel.
+class EnvironmentMap {
+public:
+	EnvironmentMap();
+	EnvironmentMap(const TextureMap &image, EnvironmentLayout layout);
+	bool isLoaded() const;
+	// The colour seen in a direction, blurred more the rougher the surface it's reflected in (0 sharp, 1 the
+	// blurriest mip)
+	glm::vec3 lookup(const glm::vec3 &direction, float roughness = 0) const;
+	// Picks a direction with probability in proportion to how bright the map is that way, from two numbers from 0
+	// to 1, and gives its probability density per steradian
+	glm::vec3 sampleDirection(float u1, float u2, float &pdf) const;
+	// Probability density per steradian of sampleDirection picking a direction
+	float pdf(const glm::vec3 &direction) const;
+
+private:
+	struct Level {
+		size_t width;
+		size_t height;
+		std::vector<glm::vec3> texels;
+
+		glm::vec3 bilinear(float u, float v) const;
+	};
+
+	std::vector<Level> levels;  // mips, sharpest first
+	std::vector<float> rowCdf;  // height+1 entries from 0 to 1
+	std::vector<float> columnCdfs;  // for each row, width+1 entries from 0 to 1
+	float totalWeight{};
+
+	// importance of a texel of the sharpest mip for sampling
+	float texelWeight(size_t x, size_t y) const;
+	void buildMips();
+	void buildCdf();
+};
@@ -0,0 +1,17 @@
+#include "GBuffer.h"
+#include <algorithm>
+
+GBuffer::GBuffer() = default;
+
+GBuffer::GBuffer(size_t w, size_t h) :
+		width(w),
+		height(h),
+		normals(w * h),
+		tangents(w * h),
+		materialIndices(w * h, NO_MATERIAL),
+		texturePoints(w * h) {}
+
+void GBuffer::clear() {
+	// the other attributes are only read where a material has been written
+	std::fill(materialIndices.begin(), materialIndices.end(), NO_MATERIAL);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "TexturePoint.h"
+
+#define NO_MATERIAL UINT32_MAX
+
+// Per-pixel surface attributes written by the rasteriser so that lighting can be done afterwards, once per visible
+// pixel. Depth isn't duplicated here: it's the rasteriser's depth buffer.
+struct GBuffer {
+	size_t width{};
+	size_t height{};
+	std::vector<glm::vec3> normals;  // interpolated from the vertex normals, so not quite unit length
+	std::vector<glm::vec4> tangents;  // interpolated from the vertex tangents, for normal maps
+	std::vector<uint32_t> materialIndices;  // NO_MATERIAL where nothing was drawn
+	std::vector<TexturePoint> texturePoints;
+
+	GBuffer();
+	GBuffer(size_t w, size_t h);
+	void clear();
+};
@@ -0,0 +1,75 @@
+#include "Hud.h"
+#include <cctype>
+#include <cstdio>
+
+namespace {
+	// Each glyph is 5 rows of 3 pixels, one octal digit per row from the top, with the highest bit on the left
+	const uint16_t DIGIT_GLYPHS[10] = {
+		075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111, 075757, 075717};
+	const uint16_t LETTER_GLYPHS[26] = {
+		025755, 065656, 034443, 065556, 074647, 074644, 034553, 055755, 072227, 011152, 055655, 044447, 057755,
+		065555, 025552, 065644, 025563, 065655, 034216, 072222, 055557, 055552, 055775, 055255, 055222, 071247};
+
+	uint16_t glyphFor(char c) {
+		if (std::isdigit((unsigned char) c)) return DIGIT_GLYPHS[c - '0'];
+		if (std::isalpha((unsigned char) c)) return LETTER_GLYPHS[std::tolower((unsigned char) c) - 'a'];
+		switch (c) {
+			case '.': return 000002;
+			case ':': return 002020;
+			case '/': return 011244;
+			case '-': return 000700;
+			case '%': return 051245;
+			default: return 0;
+		}
+	}
+
+	void drawGlyph(DrawingWindow &window, int x, int y, uint16_t glyph, uint32_t colour, int scale) {
+		for (int row = 0; row < 5; row++) {
+			for (int column = 0; column < 3; column++) {
+				if (!(glyph >> ((4-row)*3 + (2-column)) & 1)) continue;
+				for (int dy = 0; dy < scale; dy++) {
+					for (int dx = 0; dx < scale; dx++) {
+						// setPixelColour ignores anything off the window
+						window.setPixelColour(x + column*scale + dx, y + row*scale + dy, colour);
+					}
+				}
+			}
+		}
+	}
+}
+
+void drawText(DrawingWindow &window, int x, int y, const std::string &text, uint32_t colour, int scale) {
+	for (size_t i = 0; i < text.size(); i++) {
+		uint16_t glyph = glyphFor(text[i]);
+		int glyphX = x + i*4*scale;
+		drawGlyph(window, glyphX + 1, y + 1, glyph, 0xFF000000, scale);
+		drawGlyph(window, glyphX, y, glyph, colour, scale);
+	}
+}
+
+void drawHud(DrawingWindow &window, const std::vector<StageTime> &stages, double frameMilliseconds,
+		double raysPerSecond, const OcclusionStats &occlusion) {
+	const uint32_t white = 0xFFFFFFFF;
+	const uint32_t yellow = 0xFFFFFF00;
+	int scale = 2;
+	int lineHeight = 7*scale;
+	int y = 4;
+	char line[64];
+	for (const StageTime &stage : stages) {
+		std::snprintf(line, sizeof(line), "%-12s%6.2f ms", stage.name, stage.milliseconds);
+		drawText(window, 4, y, line, white, scale);
+		y += lineHeight;
+	}
+	std::snprintf(line, sizeof(line), "%-12s%6.2f ms", "frame", frameMilliseconds);
+	drawText(window, 4, y, line, yellow, scale);
+	y += lineHeight;
+	std::snprintf(line, sizeof(line), "%-12s%6.2f m", "rays/s", raysPerSecond / 1e6);
+	drawText(window, 4, y, line, yellow, scale);
+	if (occlusion.trianglesTested == 0) return;
+	y += lineHeight;
+	std::snprintf(line, sizeof(line), "%-12s%6.1f %%", "nodes culled", occlusion.nodesCulledPercent());
+	drawText(window, 4, y, line, yellow, scale);
+	y += lineHeight;
+	std::snprintf(line, sizeof(line), "%-12s%6.1f %%", "tris culled", occlusion.trianglesCulledPercent());
+	drawText(window, 4, y, line, yellow, scale);
+}
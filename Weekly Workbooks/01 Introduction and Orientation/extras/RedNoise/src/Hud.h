@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <DrawingWindow.h>
+#include "DepthPyramid.h"
+#include "Profiler.h"
+
+// Draws text in a 3x5 pixel font scaled up by scale, with a shadow so it reads over any background. Knows digits,
+// letters (all in one case) and . : / - %
+void drawText(DrawingWindow &window, int x, int y, const std::string &text, uint32_t colour, int scale);
+// Overlay in the top-left corner with the time per stage, the frame time and rays per second, and what occlusion
+// culling rejected if the frame was rasterised with it
+void drawHud(DrawingWindow &window, const std::vector<StageTime> &stages, double frameMilliseconds,
+	double raysPerSecond, const OcclusionStats &occlusion);
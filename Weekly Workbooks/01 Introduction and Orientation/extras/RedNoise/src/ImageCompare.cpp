@@ -0,0 +1,69 @@
+#include "ImageCompare.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+namespace {
+	int red(uint32_t colour) { return (colour >> 16) & 0xFF; }
+	int green(uint32_t colour) { return (colour >> 8) & 0xFF; }
+	int blue(uint32_t colour) { return colour & 0xFF; }
+}
+
+double ImageDifference::differingFraction() const {
+	return totalPixels == 0 ? 0 : double(differingPixels) / totalPixels;
+}
+
+std::ostream &operator<<(std::ostream &os, const ImageDifference &difference) {
+	os << difference.differingPixels << "/" << difference.totalPixels << " pixels differ ("
+	   << difference.differingFraction() * 100 << "%), largest difference " << difference.largestDistance
+	   << ", PSNR " << difference.psnr << " dB";
+	return os;
+}
+
+double colourDistance(uint32_t a, uint32_t b) {
+	double meanRed = (red(a) + red(b)) / 2.0;
+	double deltaRed = red(a) - red(b);
+	double deltaGreen = green(a) - green(b);
+	double deltaBlue = blue(a) - blue(b);
+	double distance = std::sqrt((2 + meanRed/256) * deltaRed*deltaRed + 4 * deltaGreen*deltaGreen +
+		(2 + (255 - meanRed)/256) * deltaBlue*deltaBlue);
+	return distance / 765;  // about the distance from black to white
+}
+
+ImageDifference compareImages(const std::vector<uint32_t> &actual, const std::vector<uint32_t> &reference,
+		double tolerance, std::vector<uint32_t> *diff) {
+	ImageDifference difference;
+	difference.totalPixels = std::min(actual.size(), reference.size());
+	if (diff) diff->assign(difference.totalPixels, 0);
+	double squaredError = 0;
+	for (size_t i = 0; i < difference.totalPixels; i++) {
+		for (int shift = 0; shift <= 16; shift += 8) {
+			double channelError = int((actual[i] >> shift) & 0xFF) - int((reference[i] >> shift) & 0xFF);
+			squaredError += channelError * channelError;
+		}
+		double distance = colourDistance(actual[i], reference[i]);
+		difference.largestDistance = std::max(difference.largestDistance, distance);
+		bool differs = distance > tolerance;
+		if (differs) difference.differingPixels++;
+		if (diff) {
+			int grey = (red(reference[i]) + green(reference[i]) + blue(reference[i])) / 12;
+			int highlight = differs ? 128 + std::min(127, int(distance * 4 * 127)) : grey;
+			(*diff)[i] = (255 << 24) + (highlight << 16) + (grey << 8) + grey;
+		}
+	}
+	double meanSquaredError = squaredError / (3.0 * std::max(difference.totalPixels, size_t(1)));
+	difference.psnr = meanSquaredError == 0 ? std::numeric_limits<double>::infinity() :
+		10 * std::log10(255.0 * 255.0 / meanSquaredError);
+	return difference;
+}
+
+void writePpm(const std::string &fileName, size_t width, size_t height, const std::vector<uint32_t> &pixels) {
+	std::ofstream outputStream(fileName, std::ofstream::binary);
+	outputStream << "P6\n" << width << " " << height << "\n255\n";
+	for (uint32_t pixel : pixels) {
+		outputStream.put(char(red(pixel)));
+		outputStream.put(char(green(pixel)));
+		outputStream.put(char(blue(pixel)));
+	}
+}
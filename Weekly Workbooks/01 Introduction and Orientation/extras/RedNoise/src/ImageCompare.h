@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// How far a rendered image is from a reference image of the same size
+struct ImageDifference {
+	size_t differingPixels{};  // further apart than the tolerance
+	size_t totalPixels{};
+	double largestDistance{};  // see colourDistance
+	double psnr{};  // peak signal-to-noise ratio over all channels, in dB (infinite if identical)
+
+	double differingFraction() const;
+	friend std::ostream &operator<<(std::ostream &os, const ImageDifference &difference);
+};
+
+std::ostream &operator<<(std::ostream &os, const ImageDifference &difference);
+
+// How different two packed ARGB colours look, from 0 (same) to about 1 (black and white). Uses the "redmean"
+// weighting, which follows how the eye sees colour differences more closely than plain RGB distance does.
+double colourDistance(uint32_t a, uint32_t b);
+// Compares images pixel by pixel, counting pixels whose colourDistance is over tolerance. If diff isn't null it's
+// filled with an image of the differences: the reference faded to grey, with differing pixels in red.
+ImageDifference compareImages(const std::vector<uint32_t> &actual, const std::vector<uint32_t> &reference,
+	double tolerance, std::vector<uint32_t> *diff);
+void writePpm(const std::string &fileName, size_t width, size_t height, const std::vector<uint32_t> &pixels);
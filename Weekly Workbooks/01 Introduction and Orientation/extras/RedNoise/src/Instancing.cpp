@@ -0,0 +1,71 @@
+#include "Instancing.h"
+#include <algorithm>
+#include <utility>
+
+InstancedMesh::InstancedMesh() = default;
+
+InstancedMesh::InstancedMesh(std::vector<ModelTriangle> meshTriangles)
+	: triangles(std::move(meshTriangles)), bvh(triangles), wideBvh(bvh) {}
+
+void InstancedScene::clear() {
+	meshes.clear();
+	instances.clear();
+	topLevel = Bvh();
+	triangleCount = 0;
+}
+
+size_t InstancedScene::addMesh(std::vector<ModelTriangle> triangles) {
+	meshes.push_back(InstancedMesh(std::move(triangles)));
+	return meshes.size() - 1;
+}
+
+void InstancedScene::addInstance(size_t meshIndex, const glm::mat4 &objectToWorld) {
+	MeshInstance instance;
+	instance.meshIndex = meshIndex;
+	instance.objectToWorld = objectToWorld;
+	instance.worldToObject = glm::inverse(objectToWorld);
+	instance.normalToWorld = glm::transpose(glm::mat3(instance.worldToObject));
+	// the world bounds of the transformed corners of the mesh's bounds
+	const InstancedMesh &mesh = meshes[meshIndex];
+	if (!mesh.bvh.nodes.empty()) {
+		const Aabb &meshBounds = mesh.bvh.nodes[0].bounds;
+		for (int i = 0; i < 8; i++) {
+			glm::vec3 corner((i & 1) ? meshBounds.max.x : meshBounds.min.x,
+				(i & 2) ? meshBounds.max.y : meshBounds.min.y, (i & 4) ? meshBounds.max.z : meshBounds.min.z);
+			instance.bounds.grow(glm::vec3(objectToWorld * glm::vec4(corner, 1)));
+		}
+	}
+	instance.firstTriangleId = triangleCount;
+	triangleCount += mesh.triangles.size();
+	instances.push_back(instance);
+}
+
+void InstancedScene::build() {
+	std::vector<Aabb> bounds(instances.size());
+	std::vector<glm::vec3> centroids(instances.size());
+	for (size_t i = 0; i < instances.size(); i++) {
+		bounds[i] = instances[i].bounds;
+		centroids[i] = instances[i].bounds.centre();
+	}
+	topLevel = Bvh(bounds, centroids);
+}
+
+size_t InstancedScene::instanceOf(uint32_t triangleId) const {
+	// the last instance whose triangles start at or before the ID
+	auto after = std::upper_bound(instances.begin(), instances.end(), triangleId,
+		[](uint32_t id, const MeshInstance &instance) { return id < instance.firstTriangleId; });
+	return after - instances.begin() - 1;
+}
+
+ModelTriangle InstancedScene::worldTriangle(size_t instance, size_t triangle) const {
+	const MeshInstance &placement = instances[instance];
+	ModelTriangle moved = meshes[placement.meshIndex].triangles[triangle];
+	for (int i = 0; i < 3; i++) {
+		moved.vertices[i] = glm::vec3(placement.objectToWorld * glm::vec4(moved.vertices[i], 1));
+		moved.vertexNormals[i] = glm::normalize(placement.normalToWorld * moved.vertexNormals[i]);
+		glm::vec3 tangent = glm::vec3(placement.objectToWorld * glm::vec4(glm::vec3(moved.vertexTangents[i]), 0));
+		moved.vertexTangents[i] = glm::vec4(glm::normalize(tangent), moved.vertexTangents[i].w);
+	}
+	moved.normal = glm::normalize(placement.normalToWorld * moved.normal);
+	return moved;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "ModelTriangle.h"
+#include "WideBvh.h"
+
+// A mesh stored once however many times it's placed, in its own object space, with a BVH over its triangles
+struct InstancedMesh {
+	std::vector<ModelTriangle> triangles;
+	Bvh bvh;
+	WideBvh wideBvh;  // made from bvh
+
+	InstancedMesh();
+	explicit InstancedMesh(std::vector<ModelTriangle> meshTriangles);
+};
+
+// One placement of a mesh in the scene
+struct MeshInstance {
+	uint32_t meshIndex;
+	glm::mat4 objectToWorld;
+	glm::mat4 worldToObject;
+	glm::mat3 normalToWorld;  // inverse transpose of objectToWorld's rotation and scale, for normals
+	Aabb bounds;  // in world space
+	uint32_t firstTriangleId;  // this instance's triangles are numbered on from here (see InstancedScene)
+};
+
+// A two-level scene: meshes, the instances placing them in the world, and a top-level BVH over the instances' world
+// bounds. Memory grows with the meshes' triangles, plus a transform and a couple of nodes per instance. Rays are
+// traced through an instance by moving them into its object space instead of moving its triangles into the world.
+// Every placed triangle has an ID, running on through the instances in order, so that they can be told apart.
+class InstancedScene {
+public:
+	std::vector<InstancedMesh> meshes;
+	std::vector<MeshInstance> instances;
+	Bvh topLevel;  // its triangleIndices are indices into instances
+	uint32_t triangleCount{};  // placed, over every instance
+
+	void clear();
+	size_t addMesh(std::vector<ModelTriangle> triangles);
+	void addInstance(size_t meshIndex, const glm::mat4 &objectToWorld);
+	// Builds the top-level BVH. Call once every instance has been added.
+	void build();
+	// Index of the instance that placed the triangle with this ID
+	size_t instanceOf(uint32_t triangleId) const;
+	// A copy of one of the instance's mesh's triangles, moved into the world
+	ModelTriangle worldTriangle(size_t instance, size_t triangle) const;
+};
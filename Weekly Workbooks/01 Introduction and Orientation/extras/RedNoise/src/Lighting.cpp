@@ -0,0 +1,31 @@
+#include "Lighting.h"
+#include <algorithm>
+#include <cmath>
+
+float proximityLighting(float distanceToLight, float lightStrength) {
+	return std::min(1.0f, lightStrength / float(4 * M_PI * distanceToLight * distanceToLight));
+}
+
+float angleOfIncidenceLighting(const glm::vec3 &normal, const glm::vec3 &directionToLight) {
+	return std::max(0.0f, glm::dot(normal, directionToLight));
+}
+
+float specularLighting(const glm::vec3 &normal, const glm::vec3 &directionToLight, const glm::vec3 &directionToViewer,
+		float specularExponent) {
+	glm::vec3 reflection = glm::reflect(-directionToLight, normal);
+	return std::pow(std::max(0.0f, glm::dot(reflection, directionToViewer)), specularExponent);
+}
+
+float computeBrightness(const glm::vec3 &point, const glm::vec3 &normal, const glm::vec3 &viewPosition,
+		const glm::vec3 &lightPosition, float lightStrength, float specularExponent, float ambientLight,
+		float lightVisibility) {
+	glm::vec3 toLight = lightPosition - point;
+	float distanceToLight = glm::length(toLight);
+	glm::vec3 directionToLight = toLight / distanceToLight;
+	glm::vec3 directionToViewer = glm::normalize(viewPosition - point);
+
+	float brightness = proximityLighting(distanceToLight, lightStrength) *
+		angleOfIncidenceLighting(normal, directionToLight);
+	brightness += specularLighting(normal, directionToLight, directionToViewer, specularExponent);
+	return std::min(1.0f, std::max(ambientLight, brightness * lightVisibility));
+}
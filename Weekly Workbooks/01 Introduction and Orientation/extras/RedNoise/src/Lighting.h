@@ -0,0 +1,19 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Brightness terms (0 to 1) from the Lighting and Shading workbook. Directions are normalised and point away from
+// the surface.
+
+// falls off with the inverse square of the distance to the light
+float proximityLighting(float distanceToLight, float lightStrength);
+// how squarely the surface faces the light
+float angleOfIncidenceLighting(const glm::vec3 &normal, const glm::vec3 &directionToLight);
+// highlight where the light reflects off the surface towards the viewer
+float specularLighting(const glm::vec3 &normal, const glm::vec3 &directionToLight, const glm::vec3 &directionToViewer,
+	float specularExponent);
+// all of the above, scaled by how much of the light reaches the point (e.g. from a shadow map), and never darker than
+// the ambient threshold
+float computeBrightness(const glm::vec3 &point, const glm::vec3 &normal, const glm::vec3 &viewPosition,
+	const glm::vec3 &lightPosition, float lightStrength, float specularExponent, float ambientLight,
+	float lightVisibility = 1);
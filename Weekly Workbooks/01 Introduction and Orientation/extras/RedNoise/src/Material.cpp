@@ -0,0 +1,19 @@
+#include "Material.h"
+#include <utility>
+
+Material::Material() = default;
+Material::Material(std::string n, const Colour &c) : name(std::move(n)), colour(c) {}
+
+bool Material::hasTexture() const {
+	return !texture.pixels.empty();
+}
+
+std::ostream &operator<<(std::ostream &os, const Material &material) {
+	os << material.name << " " << material.colour << " specular exponent " << material.specularExponent;
+	if (material.hasTexture()) os << " texture " << material.texture;
+	if (material.normalMap.isLoaded()) os << " normal map " << material.normalMap.width << "x" << material.normalMap.height;
+	if (material.type == MIRROR) os << " mirror";
+	else if (material.type == METAL) os << " metal roughness " << material.roughness;
+	else if (material.type == DIELECTRIC) os << " dielectric refractive index " << material.refractiveIndex;
+	return os;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include "Colour.h"
+#include "NormalMap.h"
+#include "TextureMap.h"
+
+// How the ray tracer treats light arriving at a surface. The rasterisers draw everything as diffuse.
+enum MaterialType { DIFFUSE, MIRROR, METAL, DIELECTRIC };
+
+struct Material {
+	std::string name;
+	Colour colour{};
+	float specularExponent{64};
+	TextureMap texture{};  // only loaded if the material has a map_Kd
+	NormalMap normalMap{};  // only loaded if the material has a norm or map_Bump
+	MaterialType type{DIFFUSE};
+	float roughness{};  // for metal: how far reflections scatter from the mirror direction, from 0 (a tinted mirror)
+	float refractiveIndex{1.5};  // for dielectrics
+
+	Material();
+	Material(std::string n, const Colour &c);
+	bool hasTexture() const;
+	friend std::ostream &operator<<(std::ostream &os, const Material &material);
+};
+
+std::ostream &operator<<(std::ostream &os, const Material &material);
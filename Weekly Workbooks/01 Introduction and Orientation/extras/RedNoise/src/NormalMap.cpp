@@ -0,0 +1,129 @@
+#include "NormalMap.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace {
+	std::array<float, 3> positionKey(const glm::vec3 &position) {
+		return {{position.x, position.y, position.z}};
+	}
+
+	// angle of the triangle at its vertex i
+	float cornerAngle(const ModelTriangle &triangle, int i) {
+		glm::vec3 a = triangle.vertices[(i + 1) % 3] - triangle.vertices[i];
+		glm::vec3 b = triangle.vertices[(i + 2) % 3] - triangle.vertices[i];
+		float lengths = glm::length(a) * glm::length(b);
+		if (lengths == 0) return 0;
+		return std::acos(glm::clamp(glm::dot(a, b) / lengths, -1.0f, 1.0f));
+	}
+
+	// any unit vector perpendicular to the normal
+	glm::vec3 perpendicular(const glm::vec3 &normal) {
+		glm::vec3 other = std::abs(normal.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+		return glm::normalize(glm::cross(other, normal));
+	}
+}
+
+void computeVertexNormals(std::vector<ModelTriangle> &triangles, size_t first, float creaseAngle) {
+	// the corners (triangle index * 3 + vertex) at each position
+	std::map<std::array<float, 3>, std::vector<size_t>> corners;
+	for (size_t t = first; t < triangles.size(); t++) {
+		for (int i = 0; i < 3; i++) corners[positionKey(triangles[t].vertices[i])].push_back(t*3 + i);
+	}
+	float creaseCosine = std::cos(creaseAngle);
+	for (size_t t = first; t < triangles.size(); t++) {
+		ModelTriangle &triangle = triangles[t];
+		if (triangle.vertexNormals[0] != glm::vec3(0)) continue;
+		for (int i = 0; i < 3; i++) {
+			glm::vec3 sum(0);
+			for (size_t corner : corners[positionKey(triangle.vertices[i])]) {
+				const ModelTriangle &neighbour = triangles[corner / 3];
+				if (glm::dot(neighbour.normal, triangle.normal) < creaseCosine) continue;
+				sum += neighbour.normal * cornerAngle(neighbour, corner % 3);
+			}
+			triangle.vertexNormals[i] = glm::length(sum) > 0 ? glm::normalize(sum) : triangle.normal;
+		}
+	}
+}
+
+void computeTangents(std::vector<ModelTriangle> &triangles, size_t first) {
+	// tangent and bitangent sums at each distinct vertex: position, normal and texture point
+	typedef std::array<float, 8> VertexKey;
+	std::map<VertexKey, std::pair<glm::vec3, glm::vec3>> sums;
+	auto key = [&](const ModelTriangle &triangle, int i) {
+		const glm::vec3 &p = triangle.vertices[i];
+		const glm::vec3 &n = triangle.vertexNormals[i];
+		const TexturePoint &uv = triangle.texturePoints[i];
+		return VertexKey{{p.x, p.y, p.z, n.x, n.y, n.z, uv.x, uv.y}};
+	};
+
+	for (size_t t = first; t < triangles.size(); t++) {
+		const ModelTriangle &triangle = triangles[t];
+		glm::vec3 edge1 = triangle.vertices[1] - triangle.vertices[0];
+		glm::vec3 edge2 = triangle.vertices[2] - triangle.vertices[0];
+		float du1 = triangle.texturePoints[1].x - triangle.texturePoints[0].x;
+		float dv1 = triangle.texturePoints[1].y - triangle.texturePoints[0].y;
+		float du2 = triangle.texturePoints[2].x - triangle.texturePoints[0].x;
+		float dv2 = triangle.texturePoints[2].y - triangle.texturePoints[0].y;
+		float determinant = du1*dv2 - du2*dv1;
+		// without texture points there's no direction to follow, so the fallback below picks one
+		if (std::abs(determinant) < 1e-12f) continue;
+		glm::vec3 tangent = (edge1*dv2 - edge2*dv1) / determinant;
+		glm::vec3 bitangent = (edge2*du1 - edge1*du2) / determinant;
+		for (int i = 0; i < 3; i++) {
+			float angle = cornerAngle(triangle, i);
+			std::pair<glm::vec3, glm::vec3> &sum = sums[key(triangle, i)];
+			sum.first += tangent * angle;
+			sum.second += bitangent * angle;
+		}
+	}
+
+	for (size_t t = first; t < triangles.size(); t++) {
+		ModelTriangle &triangle = triangles[t];
+		for (int i = 0; i < 3; i++) {
+			const glm::vec3 &normal = triangle.vertexNormals[i];
+			auto sum = sums.find(key(triangle, i));
+			glm::vec3 tangent = sum == sums.end() ? glm::vec3(0) : sum->second.first;
+			tangent -= normal * glm::dot(normal, tangent);
+			if (glm::length(tangent) < 1e-6f) {
+				triangle.vertexTangents[i] = glm::vec4(perpendicular(normal), 1);
+				continue;
+			}
+			tangent = glm::normalize(tangent);
+			float handedness = glm::dot(glm::cross(normal, tangent), sum->second.second) < 0 ? -1 : 1;
+			triangle.vertexTangents[i] = glm::vec4(tangent, handedness);
+		}
+	}
+}
+
+NormalMap::NormalMap() = default;
+NormalMap::NormalMap(const TextureMap &image) : width(image.width), height(image.height), texels(image.pixels.size()) {
+	for (size_t i = 0; i < image.pixels.size(); i++) {
+		// 0 to 255 stands for -1 to 1
+		int red = (image.pixels[i] >> 16) & 0xFF;
+		int green = (image.pixels[i] >> 8) & 0xFF;
+		texels[i][0] = int8_t(std::max(-127, red - 128));
+		texels[i][1] = int8_t(std::max(-127, green - 128));
+	}
+}
+
+bool NormalMap::isLoaded() const {
+	return !texels.empty();
+}
+
+glm::vec3 NormalMap::sample(const TexturePoint &point) const {
+	size_t x = std::min(size_t(std::max(0.0f, point.x * (width-1) + 0.5f)), width-1);
+	size_t y = std::min(size_t(std::max(0.0f, point.y * (height-1) + 0.5f)), height-1);
+	const std::array<int8_t, 2> &texel = texels[y*width + x];
+	// texture y runs down the image, and green points up it
+	glm::vec2 xy(texel[0] / 127.0f, -texel[1] / 127.0f);
+	return glm::vec3(xy, std::sqrt(std::max(0.0f, 1 - glm::dot(xy, xy))));
+}
+
+glm::vec3 NormalMap::perturb(const glm::vec3 &normal, const glm::vec4 &tangent, const TexturePoint &point) const {
+	glm::vec3 mapped = sample(point);
+	glm::vec3 along = glm::vec3(tangent) - normal * glm::dot(normal, glm::vec3(tangent));
+	glm::vec3 t = glm::length(along) > 1e-6f ? glm::normalize(along) : perpendicular(normal);
+	glm::vec3 bitangent = glm::cross(normal, t) * tangent.w;
+	return glm::normalize(mapped.x*t + mapped.y*bitangent + mapped.z*normal);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "ModelTriangle.h"
+#include "TexturePoint.h"
+#include "TextureMap.h"
+
+// Fills in the vertex normals of triangles [first, end) that don't have any (e.g. from the OBJ file) by averaging
+// the face normals around each vertex position, weighted by the angle each face makes there. Faces more than
+// creaseAngle (radians) from a triangle's own face aren't averaged in, so hard edges stay hard.
+void computeVertexNormals(std::vector<ModelTriangle> &triangles, size_t first, float creaseAngle);
+// Works out tangents for the vertices of triangles [first, end) from how their texture points run across them, the
+// way MikkTSpace does: each triangle's tangent and bitangent are added up, weighted by angle, at every vertex it
+// shares (same position, normal and texture point), then the tangent is made perpendicular to the vertex normal and
+// w records whether the bitangent is cross(normal, tangent) or the opposite. Needs vertex normals.
+void computeTangents(std::vector<ModelTriangle> &triangles, size_t first);
+
+// A tangent-space normal map. Only x and y are kept, as a signed byte each, and z (always towards the surface's
+// outside) is rebuilt from them, so a texel takes two bytes instead of the image's four. Maps are read the OpenGL
+// way round: red is along increasing texture x and green is up the image.
+struct NormalMap {
+	size_t width{};
+	size_t height{};
+	std::vector<std::array<int8_t, 2>> texels;
+
+	NormalMap();
+	explicit NormalMap(const TextureMap &image);
+	bool isLoaded() const;
+	// the normal in tangent space (x along the tangent, y along the bitangent, z along the normal) at a texture point
+	glm::vec3 sample(const TexturePoint &point) const;
+	// The normal at a texture point on a surface with this (interpolated) normal and tangent. The tangent is only
+	// straightened against the normal, so the basis comes from the precomputed vertex tangents.
+	glm::vec3 perturb(const glm::vec3 &normal, const glm::vec4 &tangent, const TexturePoint &point) const;
+};
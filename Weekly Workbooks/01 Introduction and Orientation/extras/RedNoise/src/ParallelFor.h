@@ -0,0 +1,28 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "Profiler.h"
+
+// Calls body(i) for every i in [0, count) across all hardware threads. Indices are handed out one at a time, so
+// expensive parts of the work (e.g. busy rows of the screen) get shared out evenly.
+template <typename Body>
+void parallelFor(size_t count, Body body) {
+	size_t threadCount = std::min(size_t(std::max(1u, std::thread::hardware_concurrency())), count);
+	std::atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i = next++; i < count; i = next++) body(i);
+	};
+	std::vector<std::thread> threads;
+	for (size_t t = 1; t < threadCount; t++) {
+		// timed on the extra threads only, as the calling thread's share is part of whatever stage called this
+		threads.emplace_back([&]() {
+			PROFILE_SCOPE("parallel for");
+			worker();
+		});
+	}
+	worker();
+	for (std::thread &thread : threads) thread.join();
+}
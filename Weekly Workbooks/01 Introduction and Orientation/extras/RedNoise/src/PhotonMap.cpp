@@ -0,0 +1,93 @@
+#include "PhotonMap.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cfloat>
+
+namespace {
+	// Number of nodes in the left subtree of a left-balanced tree of n nodes: every level is full except the last,
+	// which is filled from the left
+	size_t leftSubtreeSize(size_t n) {
+		if (n <= 1) return 0;
+		size_t lastLevelCapacity = 1;
+		while (lastLevelCapacity * 2 <= n) lastLevelCapacity *= 2;
+		size_t fullLevels = lastLevelCapacity - 1;
+		size_t lastLevel = n - fullLevels;
+		return fullLevels / 2 + std::min(lastLevel, lastLevelCapacity / 2);
+	}
+}
+
+PhotonMap::PhotonMap() = default;
+PhotonMap::PhotonMap(std::vector<Photon> unsorted) : photons(unsorted.size()) {
+	balance(unsorted, 0, unsorted.size(), 0);
+}
+
+// Puts the median of unsorted[begin, end) along its widest axis at node, and the photons either side of it in the
+// node's subtrees. The median is picked so that the left subtree gets the number of photons left-balancing needs.
+void PhotonMap::balance(std::vector<Photon> &unsorted, size_t begin, size_t end, size_t node) {
+	if (begin == end) return;
+	glm::vec3 boundsMin(FLT_MAX);
+	glm::vec3 boundsMax(-FLT_MAX);
+	for (size_t i = begin; i < end; i++) {
+		boundsMin = glm::min(boundsMin, unsorted[i].position);
+		boundsMax = glm::max(boundsMax, unsorted[i].position);
+	}
+	glm::vec3 extent = boundsMax - boundsMin;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+	size_t median = begin + leftSubtreeSize(end - begin);
+	std::nth_element(unsorted.begin() + begin, unsorted.begin() + median, unsorted.begin() + end,
+		[axis](const Photon &a, const Photon &b) { return a.position[axis] < b.position[axis]; });
+	photons[node] = unsorted[median];
+	photons[node].splitAxis = axis;
+	balance(unsorted, begin, median, 2*node + 1);
+	balance(unsorted, median + 1, end, 2*node + 2);
+}
+
+float PhotonMap::findNearest(const glm::vec3 &point, size_t count, float maxDistance,
+		std::vector<std::pair<float, uint32_t>> &nearest) const {
+	nearest.clear();
+	float radiusSquared = maxDistance * maxDistance;
+	// nodes still to visit, with the squared distance to the splitting plane that separates them from the point
+	std::array<std::pair<uint32_t, float>, 64> stack;  // deeper than a tree of 2^32 photons
+	size_t stackSize = 0;
+	if (!photons.empty()) stack[stackSize++] = std::make_pair(0u, 0.0f);
+	while (stackSize > 0) {
+		std::pair<uint32_t, float> entry = stack[--stackSize];
+		if (entry.second > radiusSquared) continue;
+		uint32_t node = entry.first;
+		const Photon &photon = photons[node];
+
+		glm::vec3 offset = photon.position - point;
+		float distanceSquared = glm::dot(offset, offset);
+		if (distanceSquared < radiusSquared) {
+			nearest.push_back(std::make_pair(distanceSquared, node));
+			std::push_heap(nearest.begin(), nearest.end());
+			if (nearest.size() > count) {
+				std::pop_heap(nearest.begin(), nearest.end());
+				nearest.pop_back();
+			}
+			if (nearest.size() == count) radiusSquared = nearest.front().first;
+		}
+
+		// visit the child on the point's side of the plane first
+		float planeDistance = point[photon.splitAxis] - photon.position[photon.splitAxis];
+		uint32_t nearChild = planeDistance < 0 ? 2*node + 1 : 2*node + 2;
+		uint32_t farChild = planeDistance < 0 ? 2*node + 2 : 2*node + 1;
+		if (farChild < photons.size()) stack[stackSize++] = std::make_pair(farChild, planeDistance * planeDistance);
+		if (nearChild < photons.size()) stack[stackSize++] = std::make_pair(nearChild, 0.0f);
+	}
+	return radiusSquared;
+}
+
+glm::vec3 PhotonMap::irradiance(const glm::vec3 &point, const glm::vec3 &normal, size_t count,
+		float maxDistance) const {
+	thread_local std::vector<std::pair<float, uint32_t>> nearest;
+	float radiusSquared = findNearest(point, count, maxDistance, nearest);
+	glm::vec3 power(0);
+	for (const std::pair<float, uint32_t> &found : nearest) {
+		const Photon &photon = photons[found.second];
+		if (glm::dot(photon.direction, normal) < 0) power += photon.power;
+	}
+	return power / float(M_PI * radiusSquared);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Light that reached a diffuse surface after bouncing at least once: indirect light and caustics
+struct Photon {
+	glm::vec3 position;
+	glm::vec3 power;  // per colour channel, in the units of lightStrength
+	glm::vec3 direction;  // the way it was travelling, into the surface
+	uint8_t splitAxis;  // of the kd-tree node the photon is stored at
+};
+
+// Photons in a left-balanced kd-tree stored like a heap: the root is photons[0] and the children of photons[i] are
+// photons[2i+1] and photons[2i+2]. Left-balancing fills the array without gaps, so the tree needs no child indices,
+// and neighbouring nodes near the root share cache lines.
+class PhotonMap {
+public:
+	std::vector<Photon> photons;
+	glm::vec3 lightPosition{};
+	bool isBuilt{};  // false until photons have been emitted from lightPosition into the current scene
+
+	PhotonMap();
+	explicit PhotonMap(std::vector<Photon> unsorted);
+	// Finds up to count photons within maxDistance of a point, as (squared distance, index into photons) pairs in a
+	// max-heap, and returns the squared radius they were gathered from
+	float findNearest(const glm::vec3 &point, size_t count, float maxDistance,
+		std::vector<std::pair<float, uint32_t>> &nearest) const;
+	// Light arriving at a point on a surface per unit area, per colour channel, estimated from the nearest count
+	// photons (within maxDistance) that arrived from the side the normal faces
+	glm::vec3 irradiance(const glm::vec3 &point, const glm::vec3 &normal, size_t count, float maxDistance) const;
+
+private:
+	void balance(std::vector<Photon> &unsorted, size_t begin, size_t end, size_t node);
+};
@@ -0,0 +1,116 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+std::atomic<bool> profilingEnabled(false);
+
+namespace {
+	// One thread's most recent events. Rings outlive their threads and are handed on to new threads, so that the
+	// short-lived threads of parallelFor don't each leave a ring behind.
+	struct ProfileRing {
+		uint32_t id;  // used as the thread ID in traces
+		std::array<ProfileEvent, PROFILE_RING_SIZE> events;
+		uint64_t count{};  // events ever recorded
+	};
+
+	std::mutex ringsMutex;
+	std::vector<std::unique_ptr<ProfileRing>> rings;
+	std::vector<ProfileRing *> freeRings;
+
+	// Takes a ring when its thread first records something and gives it back when the thread exits
+	struct RingHandle {
+		ProfileRing *ring{};
+
+		ProfileRing &get() {
+			if (ring) return *ring;
+			std::lock_guard<std::mutex> lock(ringsMutex);
+			if (!freeRings.empty()) {
+				ring = freeRings.back();
+				freeRings.pop_back();
+			} else {
+				rings.emplace_back(new ProfileRing());
+				ring = rings.back().get();
+				ring->id = rings.size();
+			}
+			return *ring;
+		}
+
+		~RingHandle() {
+			if (!ring) return;
+			std::lock_guard<std::mutex> lock(ringsMutex);
+			freeRings.push_back(ring);
+		}
+	};
+
+	thread_local RingHandle threadRing;
+
+	// the buffered events of a ring, oldest first
+	std::vector<ProfileEvent> bufferedEvents(const ProfileRing &ring) {
+		std::vector<ProfileEvent> events;
+		uint64_t first = ring.count > PROFILE_RING_SIZE ? ring.count - PROFILE_RING_SIZE : 0;
+		for (uint64_t i = first; i < ring.count; i++) events.push_back(ring.events[i % PROFILE_RING_SIZE]);
+		return events;
+	}
+}
+
+uint64_t profileClockNanoseconds() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ScopedTimer::ScopedTimer(const char *n) : name(n) {
+	if (profilingEnabled.load(std::memory_order_relaxed)) start = profileClockNanoseconds();
+}
+
+ScopedTimer::~ScopedTimer() {
+	if (start == 0) return;
+	ProfileRing &ring = threadRing.get();
+	ring.events[ring.count % PROFILE_RING_SIZE] = {name, start, profileClockNanoseconds()};
+	ring.count++;
+}
+
+std::vector<StageTime> summariseProfile(uint64_t since) {
+	std::vector<StageTime> stages;
+	// events are recorded as they end, so sort by start to get the order the stages began in
+	std::vector<ProfileEvent> events = bufferedEvents(threadRing.get());
+	std::stable_sort(events.begin(), events.end(),
+		[](const ProfileEvent &a, const ProfileEvent &b) { return a.start < b.start; });
+	for (const ProfileEvent &event : events) {
+		if (event.start < since) continue;
+		auto stage = std::find_if(stages.begin(), stages.end(),
+			[&](const StageTime &s) { return std::strcmp(s.name, event.name) == 0; });
+		if (stage == stages.end()) {
+			stages.push_back({event.name, 0});
+			stage = stages.end() - 1;
+		}
+		stage->milliseconds += (event.end - event.start) / 1e6;
+	}
+	return stages;
+}
+
+void writeChromeTrace(std::ostream &os) {
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	std::vector<std::vector<ProfileEvent>> events;
+	uint64_t earliest = UINT64_MAX;
+	for (const std::unique_ptr<ProfileRing> &ring : rings) {
+		events.push_back(bufferedEvents(*ring));
+		for (const ProfileEvent &event : events.back()) earliest = std::min(earliest, event.start);
+	}
+
+	os << "{\"traceEvents\": [\n" << std::fixed << std::setprecision(3);
+	bool first = true;
+	for (size_t i = 0; i < rings.size(); i++) {
+		for (const ProfileEvent &event : events[i]) {
+			// complete ("X") events, with times in microseconds
+			os << (first ? "" : ",\n") << "\t{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1"
+				<< ", \"tid\": " << rings[i]->id << ", \"ts\": " << (event.start - earliest) / 1e3
+				<< ", \"dur\": " << (event.end - event.start) / 1e3 << "}";
+			first = false;
+		}
+	}
+	os << "\n]}\n";
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define PROFILE_RING_SIZE 4096  // events kept per thread; older ones are overwritten
+
+// Timing of one pipeline stage: the name is a string literal, times are from profileClockNanoseconds()
+struct ProfileEvent {
+	const char *name;
+	uint64_t start;
+	uint64_t end;
+};
+
+// Total time spent in a stage over some period
+struct StageTime {
+	const char *name;
+	double milliseconds;
+};
+
+// Timers do nothing but check this while it's off
+extern std::atomic<bool> profilingEnabled;
+
+uint64_t profileClockNanoseconds();
+
+// Records how long the enclosing scope took into the calling thread's ring buffer
+class ScopedTimer {
+public:
+	explicit ScopedTimer(const char *n);
+	~ScopedTimer();
+	ScopedTimer(const ScopedTimer &) = delete;
+	ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+	const char *name;
+	uint64_t start{};  // 0 if profiling was off when the scope began
+};
+
+#define PROFILE_CONCATENATE_INNER(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_INNER(a, b)
+#define PROFILE_SCOPE(name) ScopedTimer PROFILE_CONCATENATE(scopedTimer, __LINE__)(name)
+
+// Time per stage, in the order the stages were first entered, from the calling thread's events that started at or
+// after since. Stages run on worker threads aren't included: time the call that shares out the work instead.
+std::vector<StageTime> summariseProfile(uint64_t since);
+// Writes every thread's buffered events in the Chrome trace event format (load in chrome://tracing or Perfetto).
+// Only call this when no other thread is recording.
+void writeChromeTrace(std::ostream &os);
@@ -0,0 +1,158 @@
+#include "RayPacket.h"
+#include <algorithm>
+#include "Simd.h"
+
+RayPacket::RayPacket() {
+	for (int i = 0; i < PACKET_SIZE; i++) {
+		directionZ[i] = -1;
+		closestDistances[i] = -1;
+		closestIndices[i] = -1;
+	}
+	prepare();
+}
+
+void RayPacket::setRay(int lane, const glm::vec3 &direction, float maxDistance) {
+	directionX[lane] = direction.x;
+	directionY[lane] = direction.y;
+	directionZ[lane] = direction.z;
+	closestDistances[lane] = maxDistance;
+}
+
+void RayPacket::prepare() {
+	float *directions[3] = {directionX, directionY, directionZ};
+	float *inverseDirections[3] = {inverseDirectionX, inverseDirectionY, inverseDirectionZ};
+	for (int a = 0; a < 3; a++) {
+		minInverseDirection[a] = FLT_MAX;
+		maxInverseDirection[a] = -FLT_MAX;
+		for (int i = 0; i < PACKET_SIZE; i++) {
+			inverseDirections[a][i] = slabInverse(directions[a][i]);
+			if (closestDistances[i] < 0) continue;
+			minInverseDirection[a] = std::min(minInverseDirection[a], inverseDirections[a][i]);
+			maxInverseDirection[a] = std::max(maxInverseDirection[a], inverseDirections[a][i]);
+		}
+		// rays going both ways have no useful range
+		isAxisBounded[a] = minInverseDirection[a] > 0 || maxInverseDirection[a] < 0;
+	}
+}
+
+RayPacket RayPacket::transformed(const glm::mat4 &transform) const {
+	RayPacket moved = *this;
+	moved.origin = glm::vec3(transform * glm::vec4(origin, 1));
+	for (int i = 0; i < PACKET_SIZE; i++) {
+		glm::vec3 direction = glm::vec3(transform * glm::vec4(directionX[i], directionY[i], directionZ[i], 0));
+		moved.directionX[i] = direction.x;
+		moved.directionY[i] = direction.y;
+		moved.directionZ[i] = direction.z;
+	}
+	moved.prepare();
+	return moved;
+}
+
+unsigned RayPacket::boxMask(const Aabb &box) const {
+	// slab test as in Aabb::rayEntryDistance, four rays at a time. The rays share an origin, so the distances to the
+	// faces are the same for all of them.
+	glm::vec3 toMin = box.min - origin;
+	glm::vec3 toMax = box.max - origin;
+	unsigned mask = 0;
+	for (int i = 0; i < PACKET_SIZE; i += 4) {
+		Float4 inverseX = Float4::load(inverseDirectionX + i);
+		Float4 inverseY = Float4::load(inverseDirectionY + i);
+		Float4 inverseZ = Float4::load(inverseDirectionZ + i);
+		Float4 t0x = Float4(toMin.x) * inverseX, t1x = Float4(toMax.x) * inverseX;
+		Float4 t0y = Float4(toMin.y) * inverseY, t1y = Float4(toMax.y) * inverseY;
+		Float4 t0z = Float4(toMin.z) * inverseZ, t1z = Float4(toMax.z) * inverseZ;
+		Float4 entry = max(max(min(t0x, t1x), min(t0y, t1y)), max(min(t0z, t1z), Float4(0.0f)));
+		Float4 exit = min(min(max(t0x, t1x), max(t0y, t1y)), min(max(t0z, t1z), Float4::load(closestDistances + i)));
+		mask |= unsigned(moveMask(entry <= exit)) << i;
+	}
+	return mask;
+}
+
+bool RayPacket::mayHit(const Aabb &box) const {
+	// along each axis, the nearest any ray could cross the face it enters by and the furthest any could cross the
+	// face it leaves by. If even those don't overlap across the axes, no ray's do.
+	float entry = 0;
+	float exit = FLT_MAX;
+	for (int a = 0; a < 3; a++) {
+		if (!isAxisBounded[a]) continue;
+		bool isPositive = minInverseDirection[a] > 0;
+		float toEntryFace = (isPositive ? box.min[a] : box.max[a]) - origin[a];
+		float toExitFace = (isPositive ? box.max[a] : box.min[a]) - origin[a];
+		entry = std::max(entry, std::min(toEntryFace * minInverseDirection[a], toEntryFace * maxInverseDirection[a]));
+		exit = std::min(exit, std::max(toExitFace * minInverseDirection[a], toExitFace * maxInverseDirection[a]));
+	}
+	return entry <= exit;
+}
+
+namespace {
+	// Möller-Trumbore, which solves the same equations as getClosestIntersection's matrix inverse, for four rays at
+	// a time. Returns a bit per ray in the mask that hits the triangle nearer than its closest hit so far, having
+	// made the triangle its closest.
+	unsigned intersectTriangle(RayPacket &packet, const ModelTriangle &triangle, int index, unsigned mask,
+			RayStats &stats) {
+		glm::vec3 e0 = triangle.vertices[1] - triangle.vertices[0];
+		glm::vec3 e1 = triangle.vertices[2] - triangle.vertices[0];
+		// everything from the shared origin is the same for every ray
+		glm::vec3 fromVertex = packet.origin - triangle.vertices[0];
+		glm::vec3 q = glm::cross(fromVertex, e0);
+		float qDotE1 = glm::dot(q, e1);
+		unsigned hits = 0;
+		for (int i = 0; i < PACKET_SIZE; i += 4) {
+			unsigned groupMask = (mask >> i) & 0xF;
+			if (groupMask == 0) continue;
+			stats.triangleTests += rayCount(groupMask);
+			Float4 dx = Float4::load(packet.directionX + i);
+			Float4 dy = Float4::load(packet.directionY + i);
+			Float4 dz = Float4::load(packet.directionZ + i);
+			Float4 px = dy*Float4(e1.z) - dz*Float4(e1.y);
+			Float4 py = dz*Float4(e1.x) - dx*Float4(e1.z);
+			Float4 pz = dx*Float4(e1.y) - dy*Float4(e1.x);
+			Float4 inverseDeterminant = Float4(1.0f) / dot(Float4(e0.x), Float4(e0.y), Float4(e0.z), px, py, pz);
+			Float4 u = dot(Float4(fromVertex.x), Float4(fromVertex.y), Float4(fromVertex.z), px, py, pz) *
+				inverseDeterminant;
+			Float4 v = dot(dx, dy, dz, Float4(q.x), Float4(q.y), Float4(q.z)) * inverseDeterminant;
+			Float4 t = Float4(qDotE1) * inverseDeterminant;
+			Float4 isHit = (t > Float4(0.001f)) & (u >= Float4(0.0f)) & (v >= Float4(0.0f)) &
+				(u + v <= Float4(1.0f)) & (t < Float4::load(packet.closestDistances + i));
+			unsigned groupHits = moveMask(isHit) & groupMask;
+			if (groupHits == 0) continue;
+			for (int j = 0; j < 4; j++) {
+				if (!(groupHits & (1u << j))) continue;
+				packet.closestDistances[i + j] = t[j];
+				packet.closestIndices[i + j] = index;
+			}
+			hits |= groupHits << i;
+		}
+		return hits;
+	}
+
+	// One ray of the packet on through the subtree under root by itself, as getClosestIntersection traces its rays.
+	// Returns true if it found a nearer hit.
+	bool intersectSingly(const Bvh &bvh, const std::vector<ModelTriangle> &triangles, RayPacket &packet, int lane,
+			uint32_t root, RayStats &stats) {
+		glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+		bool isHit = false;
+		traverseBvh(bvh, root, packet.origin, direction, packet.closestDistances[lane], stats,
+				[&](const BvhNode &node, float &nearest) {
+			isHit |= intersectLeafTriangles(bvh.triangleIndices, node.leftChildOrFirstTriangle, node.triangleCount,
+				triangles, packet.origin, direction, nearest, packet.closestIndices[lane], stats);
+		});
+		return isHit;
+	}
+}
+
+unsigned intersectPacket(const Bvh &bvh, const std::vector<ModelTriangle> &triangles, RayPacket &packet,
+		RayStats &stats) {
+	unsigned hits = 0;
+	traversePacket(bvh, packet, stats, PACKET_MIN_RAYS, [&](const BvhNode &node, unsigned mask) {
+		for (uint32_t j = 0; j < node.triangleCount; j++) {
+			uint32_t index = bvh.triangleIndices[node.leftChildOrFirstTriangle + j];
+			hits |= intersectTriangle(packet, triangles[index], index, mask, stats);
+		}
+	}, [&](uint32_t nodeIndex, unsigned mask) {
+		for (int i = 0; i < PACKET_SIZE; i++) {
+			if ((mask & (1u << i)) && intersectSingly(bvh, triangles, packet, i, nodeIndex, stats)) hits |= 1u << i;
+		}
+	});
+	return hits;
+}
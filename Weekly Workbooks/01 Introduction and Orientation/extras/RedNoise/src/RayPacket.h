@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "ModelTriangle.h"
+#include "RayStats.h"
+
+#define PACKET_SIZE 16  // rays per packet, for a 4x4 block of pixels; a multiple of 4
+#define PACKET_MIN_RAYS 2  // once fewer rays than this reach a node, they go on through it one at a time
+
+// Rays from one point, such as the primary rays through a block of pixels, traced through a BVH together. There's
+// an array per component of their directions, so that four rays can be tested against a box or a triangle at once.
+// Lanes not in use have a closest distance below zero, which nothing can be nearer than.
+struct RayPacket {
+	glm::vec3 origin{};
+	float directionX[PACKET_SIZE]{};
+	float directionY[PACKET_SIZE]{};
+	float directionZ[PACKET_SIZE]{};
+	float inverseDirectionX[PACKET_SIZE]{};
+	float inverseDirectionY[PACKET_SIZE]{};
+	float inverseDirectionZ[PACKET_SIZE]{};
+	float closestDistances[PACKET_SIZE]{};
+	int closestIndices[PACKET_SIZE]{};  // of the nearest triangle hit so far, or -1
+	// the range of 1/direction along each axis over the rays in use, where it has the same sign for all of them
+	glm::vec3 minInverseDirection{};
+	glm::vec3 maxInverseDirection{};
+	bool isAxisBounded[3]{};
+
+	RayPacket();
+	void setRay(int lane, const glm::vec3 &direction, float maxDistance);
+	// Works out the inverse directions and their ranges. Call once the rays are set.
+	void prepare();
+	// The packet moved into another space (such as an instance's object space), with the same distances and hits
+	RayPacket transformed(const glm::mat4 &transform) const;
+	// A bit per ray that enters the box nearer than its closest hit so far
+	unsigned boxMask(const Aabb &box) const;
+	// false if no ray in the packet can reach the box, going by the ranges of their directions alone: one test for
+	// the whole frustum the packet fills, instead of one per ray
+	bool mayHit(const Aabb &box) const;
+};
+
+// rays in a mask of lanes
+inline int rayCount(unsigned mask) {
+	int count = 0;
+	for (; mask != 0; mask &= mask - 1) count++;
+	return count;
+}
+
+// Walks a BVH with a whole packet, nearer child first (by the distance from the packet's origin to each child's
+// centre). Each node is tested against every ray's closest hit so far. Nodes that no ray reaches are skipped, leaves
+// go to visitLeaf(node, mask) and nodes that fewer than minRays rays reach go to traceSingly(nodeIndex, mask), with a
+// bit set in mask for each ray that reaches them.
+template <typename VisitLeaf, typename TraceSingly>
+void traversePacket(const Bvh &bvh, const RayPacket &packet, RayStats &stats, int minRays, VisitLeaf visitLeaf,
+		TraceSingly traceSingly) {
+	if (bvh.nodes.empty()) return;
+	std::array<uint32_t, BVH_MAX_DEPTH + 1> stack;
+	size_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		uint32_t nodeIndex = stack[--stackSize];
+		const BvhNode &node = bvh.nodes[nodeIndex];
+		stats.nodeVisits++;
+		if (!packet.mayHit(node.bounds)) continue;
+		unsigned mask = packet.boxMask(node.bounds);
+		if (mask == 0) continue;
+		if (rayCount(mask) < minRays) {
+			traceSingly(nodeIndex, mask);
+			continue;
+		}
+		if (node.isLeaf()) {
+			visitLeaf(node, mask);
+			continue;
+		}
+
+		// the nearer child goes on the stack last so it is visited first
+		uint32_t left = node.leftChildOrFirstTriangle;
+		glm::vec3 toLeft = bvh.nodes[left].bounds.centre() - packet.origin;
+		glm::vec3 toRight = bvh.nodes[left + 1].bounds.centre() - packet.origin;
+		bool isLeftNearer = glm::dot(toLeft, toLeft) < glm::dot(toRight, toRight);
+		stack[stackSize++] = isLeftNearer ? left + 1 : left;
+		stack[stackSize++] = isLeftNearer ? left : left + 1;
+	}
+}
+
+// Traces the packet through a BVH over triangles, finding the same hits getClosestIntersection's single rays would
+// (to within rounding). Returns a bit per ray that found a hit nearer than it had, having set its closest distance
+// and index.
+unsigned intersectPacket(const Bvh &bvh, const std::vector<ModelTriangle> &triangles, RayPacket &packet,
+	RayStats &stats);
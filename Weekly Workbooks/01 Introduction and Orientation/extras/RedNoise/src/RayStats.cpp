@@ -0,0 +1,58 @@
+#include "RayStats.h"
+#include <algorithm>
+#include <glm/glm.hpp>
+
+uint64_t RayStats::rays() const {
+	return primaryRays + secondaryRays + shadowRays;
+}
+
+uint64_t RayStats::traversalCost() const {
+	return nodeVisits + triangleTests;
+}
+
+RayStats &RayStats::operator+=(const RayStats &other) {
+	primaryRays += other.primaryRays;
+	secondaryRays += other.secondaryRays;
+	shadowRays += other.shadowRays;
+	nodeVisits += other.nodeVisits;
+	triangleTests += other.triangleTests;
+	hits += other.hits;
+	return *this;
+}
+
+std::ostream &operator<<(std::ostream &os, const RayStats &stats) {
+	double rays = std::max(stats.rays(), uint64_t(1));
+	os << stats.primaryRays << " primary rays, " << stats.secondaryRays << " secondary rays, " << stats.shadowRays
+	   << " shadow rays, "
+	   << stats.nodeVisits / rays << " node visits/ray, " << stats.triangleTests / rays << " triangle tests/ray, "
+	   << stats.hits / rays << " hits/ray";
+	return os;
+}
+
+void SharedRayStats::add(const RayStats &stats) {
+	std::lock_guard<std::mutex> lock(mutex);
+	totals += stats;
+}
+
+RayStats SharedRayStats::total() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return totals;
+}
+
+void SharedRayStats::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	totals = RayStats();
+}
+
+uint32_t heatmapColour(float value) {
+	const glm::vec3 stops[] = {glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), glm::vec3(1, 1, 0), glm::vec3(1, 0, 0)};
+	glm::vec3 colour;
+	if (value >= 1) {
+		colour = glm::vec3(1);
+	} else {
+		float position = std::max(value, 0.0f) * 3;
+		int stop = std::min(int(position), 2);
+		colour = glm::mix(stops[stop], stops[stop+1], position - stop);
+	}
+	return (255 << 24) + (int(colour.r*255) << 16) + (int(colour.g*255) << 8) + int(colour.b*255);
+}
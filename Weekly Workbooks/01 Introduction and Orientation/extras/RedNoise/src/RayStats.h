@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+
+enum RayType { PRIMARY_RAY, SECONDARY_RAY, SHADOW_RAY };  // secondary rays are reflected or refracted
+
+// What tracing some rays cost. Each thread counts into its own RayStats and adds them to a SharedRayStats when it
+// finishes a batch of work (e.g. a row of pixels), so counting a ray never waits on another thread.
+struct RayStats {
+	uint64_t primaryRays{};
+	uint64_t secondaryRays{};
+	uint64_t shadowRays{};
+	uint64_t nodeVisits{};
+	uint64_t triangleTests{};
+	uint64_t hits{};
+
+	uint64_t rays() const;
+	// node visits plus triangle tests: what the heatmap shows
+	uint64_t traversalCost() const;
+	RayStats &operator+=(const RayStats &other);
+	friend std::ostream &operator<<(std::ostream &os, const RayStats &stats);
+};
+
+std::ostream &operator<<(std::ostream &os, const RayStats &stats);
+
+// Totals from all threads for the current frame
+class SharedRayStats {
+public:
+	void add(const RayStats &stats);
+	RayStats total() const;
+	void clear();
+
+private:
+	mutable std::mutex mutex;
+	RayStats totals;
+};
+
+// Colour for a heatmap value scaled to 0 to 1: blue through green and yellow to red, and white beyond 1
+uint32_t heatmapColour(float value);
@@ -0,0 +1,39 @@
+#include "RayStream.h"
+
+namespace {
+	// The low RAY_STREAM_CELL_BITS bits of a cell coordinate spread out to every third bit, for a Morton code
+	uint32_t spreadBits(uint32_t coordinate) {
+		uint32_t spread = 0;
+		for (int bit = 0; bit < RAY_STREAM_CELL_BITS; bit++) spread |= ((coordinate >> bit) & 1) << (3*bit);
+		return spread;
+	}
+}
+
+size_t RayStream::size() const {
+	return rays.size();
+}
+
+size_t RayStream::add(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) {
+	rays.push_back(StreamRay{origin, direction, maxDistance});
+	return rays.size() - 1;
+}
+
+std::vector<uint32_t> RayStream::sortedOrder(const Aabb &bounds) const {
+	const float cells = 1 << RAY_STREAM_CELL_BITS;
+	glm::vec3 cellsPerUnit = cells / glm::max(bounds.max - bounds.min, glm::vec3(1e-6f));
+	std::vector<uint32_t> keys(rays.size());
+	std::vector<uint32_t> starts((8 << 3*RAY_STREAM_CELL_BITS) + 1, 0);
+	for (size_t i = 0; i < rays.size(); i++) {
+		const StreamRay &ray = rays[i];
+		// clamped as floats, as origins outside the bounds can be too far out to convert to ints
+		glm::uvec3 cell(glm::clamp((ray.origin - bounds.min) * cellsPerUnit, glm::vec3(0), glm::vec3(cells - 1)));
+		uint32_t octant = (ray.direction.x < 0) | (ray.direction.y < 0) << 1 | (ray.direction.z < 0) << 2;
+		keys[i] = octant << 3*RAY_STREAM_CELL_BITS | spreadBits(cell.x) | spreadBits(cell.y) << 1 |
+			spreadBits(cell.z) << 2;
+		starts[keys[i] + 1]++;
+	}
+	for (size_t key = 1; key < starts.size(); key++) starts[key] += starts[key - 1];
+	std::vector<uint32_t> order(rays.size());
+	for (size_t i = 0; i < rays.size(); i++) order[starts[keys[i]]++] = i;
+	return order;
+}
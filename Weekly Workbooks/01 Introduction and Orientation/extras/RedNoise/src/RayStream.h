@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+#include "Bvh.h"
+#include "ParallelFor.h"
+#include "RayStats.h"
+
+#define RAY_STREAM_CELL_BITS 4  // per axis, for the grid rays are sorted by the origins of: 16x16x16 cells
+#define RAY_STREAM_CHUNK_SIZE 1024  // sorted rays handed to a thread at a time
+
+// A ray waiting in a RayStream
+struct StreamRay {
+	glm::vec3 origin;
+	glm::vec3 direction;
+	float maxDistance;
+};
+
+// A batch of incoherent rays (shadow, reflected, refracted or photon rays) traced in an order that keeps alike rays
+// together: by the octant of their direction, then by the cell of a grid over the scene their origin is in, taking
+// the cells in Morton order so neighbouring cells stay close. Rays that start near each other and go the same way
+// visit mostly the same nodes and triangles, so tracing them one after another finds those in the cache instead of
+// fetching them again for each ray. Results go back in the order the rays were added.
+class RayStream {
+public:
+	std::vector<StreamRay> rays;  // in the order they were added
+
+	size_t size() const;
+	// Adds a ray, returning its index in rays and in what trace gives back
+	size_t add(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance = FLT_MAX);
+	// Indices of the rays in the order to trace them, with the grid over bounds. A counting sort, so rays with the
+	// same key stay in the order they were added.
+	std::vector<uint32_t> sortedOrder(const Aabb &bounds) const;
+	// Traces the rays in sorted order across threads with trace(ray, stats), which returns what the ray found;
+	// results[i] is what rays[i] found
+	template <typename Result, typename Trace>
+	void trace(const Aabb &bounds, std::vector<Result> &results, RayStats &stats, Trace trace) const;
+};
+
+template <typename Result, typename Trace>
+void RayStream::trace(const Aabb &bounds, std::vector<Result> &results, RayStats &stats, Trace trace) const {
+	std::vector<uint32_t> order = sortedOrder(bounds);
+	results.assign(rays.size(), Result());
+	size_t chunkCount = (rays.size() + RAY_STREAM_CHUNK_SIZE - 1) / RAY_STREAM_CHUNK_SIZE;
+	std::vector<RayStats> chunkStats(chunkCount);
+	parallelFor(chunkCount, [&](size_t chunk) {
+		size_t end = std::min(rays.size(), (chunk + 1) * RAY_STREAM_CHUNK_SIZE);
+		for (size_t i = chunk * RAY_STREAM_CHUNK_SIZE; i < end; i++) {
+			results[order[i]] = trace(rays[order[i]], chunkStats[chunk]);
+		}
+	});
+	for (const RayStats &chunk : chunkStats) stats += chunk;
+}
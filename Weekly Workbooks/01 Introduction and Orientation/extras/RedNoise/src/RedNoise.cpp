@@ -1,27 +1,140 @@
 #include <algorithm>
+#include <chrono>
 #include <CanvasTriangle.h>
 #include <DrawingWindow.h>
 #include <Utils.h>
 #include <fstream>
 #include <vector>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <CanvasPoint.h>
 #include <Colour.h>
 #include <map>
+#include <numeric>
 #include <ModelTriangle.h>
 #include <RayTriangleIntersection.h>
 #include <TextureMap.h>
+#include "AdaptiveSampling.h"
+#include "AreaLight.h"
+#include "Bench.h"
+#include "Bvh.h"
+#include "DepthPyramid.h"
+#include "EnvironmentMap.h"
+#include "GBuffer.h"
+#include "Hud.h"
+#include "ImageCompare.h"
+#include "Instancing.h"
+#include "Lighting.h"
+#include "Material.h"
+#include "NormalMap.h"
+#include "ParallelFor.h"
+#include "PhotonMap.h"
+#include "RayPacket.h"
+#include "RayStats.h"
+#include "RayStream.h"
+#include "RenderFeatures.h"
+#include "ReprojectionCache.h"
+#include "Renderer.h"
+#include "Scattering.h"
+#include "SceneGenerator.h"
+#include "ShadingKernels.h"
+#include "Profiler.h"
+#include "ShadowMap.h"
+#include "VisibilityBuffer.h"
+#include "WideBvh.h"
 
 #define WIDTH 320
 #define HEIGHT 240
+#define NEAR_PLANE 0.1f  // distance in front of the camera at which rasterised triangles are clipped
+#define CREASE_ANGLE 0.5f  // radians between faces beyond which an edge is shaded as hard
 
 
 float (*depthBuffer)[320] = new float[HEIGHT][WIDTH];
 glm::vec3 cameraPosition = glm::vec3(0, 0, 16);
 glm::mat3 cameraOrientation = glm::mat3();  // right, up, forward - init to identity matrix
-std::map<std::string, Colour> colours;
+std::vector<Material> materials;
 std::vector<ModelTriangle> triangles = {};
 glm::vec3 lightPosition = glm::vec3(0, 2.6, 0);
+AreaLight areaLight;  // the shape of the light around lightPosition, for soft shadows in the ray tracer and hybrid
+int penumbraGridSize = 6;  // shadow rays in penumbrae go to this many squared points on the light
+float lightStrength = 100;
+float ambientLight = 0.2;
+bool backfaceCulling = true;
+bool occlusionCulling = true;
+Bvh sceneBvh;
+WideBvh sceneWideBvh;  // made from sceneBvh, for tracing single rays
+// sceneWideBvh is collapsed from sceneBvh again once Bvh::update has rebuilt more than this fraction of the triangles
+// since it last was, and otherwise only refitted
+float wideBvhRebuildFraction = 0.25;
+size_t trianglesRebuiltSinceWideBvh = 0;
+float bvhRebuildRatio = 1.3;  // parts of the BVH are rebuilt once refitting has made them this much slower to trace
+// meshes placed many times over, alongside the triangles. Their triangles' IDs follow on from the indices of the
+// triangles (see sceneTriangle).
+InstancedScene instancedScene;
+size_t instancedGridTriangles = 100000;  // placed by the instanced grid of Cornell boxes
+DepthPyramid depthPyramid(WIDTH, HEIGHT);
+
+OcclusionStats occlusionStats;  // for the last frame, and all zero unless it was rasterised
+
+GBuffer gBuffer(WIDTH, HEIGHT);
+VisibilityBuffer visibilityBuffer(WIDTH, HEIGHT);
+ShadowCubeMap shadowMap(512);
+bool shadowMapping = true;
+int shadowFilterRadius = 1;
+ShadingPrecision shadingPrecision = FAST_SHADING;  // for the deferred renderer's lighting pass
+
+enum RenderMode { RAY_TRACED, RASTERISED, DEFERRED, HYBRID, WIREFRAME };
+RenderMode renderMode = RAY_TRACED;
+uint64_t switchStart = 0;  // when the render mode last changed, until the new renderer's first frame is shown
+
+SharedRayStats rayStats;  // for the last ray-traced frame
+bool rayHeatmap = false;  // show how much traversal each pixel's rays took instead of the image
+bool packetTracing = true;  // trace primary rays in packets of a 4x4 block of pixels (see RayPacket.h)
+bool rayStreaming = false;  // trace secondary, shadow and photon rays in sorted batches (see RayStream.h)
+bool wideBvhTraversal = true;  // trace single rays through the wide BVHs instead of the binary ones (see WideBvh.h)
+float heatmapMaximumCost = 100;  // node visits plus triangle tests shown as red; more is white
+
+// anti-aliasing for the ray tracer: adaptive supersamples only pixels that differ from a neighbour, and 16x
+// supersamples every pixel the same way (for comparison)
+enum AntiAliasing { NO_ANTI_ALIASING, ADAPTIVE_ANTI_ALIASING, SUPERSAMPLED_16X };
+AntiAliasing antiAliasing = NO_ANTI_ALIASING;
+int adaptiveSamplingDepth = 2;  // up to 4^2 = 16 samples per edge pixel
+float edgeContrastThreshold = 0.1;  // colour distance (see colourDistance) beyond which neighbouring pixels differ
+std::vector<PixelSample> primarySamples(WIDTH * HEIGHT);
+
+// reflected and refracted rays stop after this many bounces, or once they'd add less than minRayThroughput of the
+// pixel's colour
+int maxRayDepth = 8;
+float minRayThroughput = 0.01;
+
+// indirect light and caustics for the ray tracer, from photons that have bounced at least once. The map is kept
+// until the light moves or the scene or its materials change.
+PhotonMap photonMap;
+bool photonMapping = false;
+size_t photonCount = 200000;  // emitted from the light
+size_t photonGatherCount = 64;  // nearest photons averaged for the light arriving at a point
+float photonGatherRadius = 0.5;  // furthest photons are gathered from
+
+// what the ray tracer's rays see when they miss the scene, which also lights diffuse surfaces
+EnvironmentMap environmentMap;
+int environmentSamples = 4;  // directions sampled per diffuse hit for light from the environment map
+
+// the ray tracer's last frame, reused while only the camera moves
+ReprojectionCache reprojectionCache(WIDTH, HEIGHT);
+bool reprojection = true;
+uint32_t reprojectionRefreshPeriod = 16;  // a reused pixel is traced again at least once in this many frames
+
+// the tall box going round in a circle, for trying out moving geometry
+bool animating = false;
+std::vector<size_t> animatedTriangles;
+std::vector<std::array<glm::vec3, 3>> animationRestVertices;  // where the animated triangles started
+int animationFrame = 0;
+
+bool showHud = false;  // profiling is only on while the HUD is shown
+std::vector<StageTime> hudStages;
+double hudFrameMilliseconds = 0;
+double hudRaysPerSecond = 0;
+OcclusionStats hudOcclusionStats;
 
 
 std::vector<float> interpolateSingleFloats(float from, float to, float numberOfValues) {
@@ -56,27 +169,66 @@ uint32_t packColour(Colour colour) {
 	return (255 << 24) + (int(colour.red) << 16) + (int(colour.green) << 8) + int(colour.blue);
 }
 
-void drawLine(DrawingWindow &window, CanvasPoint from, CanvasPoint to, Colour colour) {
+uint32_t packColour(Colour colour, float brightness) {
+	return packColour(Colour(colour.red*brightness, colour.green*brightness, colour.blue*brightness));
+}
+
+// Liang-Barsky clip of the parametric line from + t*(to-from) against one canvas boundary
+bool clipLineAgainstBoundary(float p, float q, float &tStart, float &tEnd) {
+	if (p == 0) return q >= 0;
+	float t = q/p;
+	if (p < 0) {
+		if (t > tEnd) return false;
+		tStart = std::max(tStart, t);
+	} else {
+		if (t < tStart) return false;
+		tEnd = std::min(tEnd, t);
+	}
+	return true;
+}
+
+// Steps along the line a pixel at a time like drawLine does, calling plot(x, y, t) for each pixel that is on the
+// canvas, where t is how far along the line (0 to 1) the pixel is
+template <typename Plot>
+void stepAlongLine(const CanvasPoint &from, const CanvasPoint &to, Plot plot, int width = WIDTH, int height = HEIGHT) {
 	float deltaX = to.x - from.x;
 	float deltaY = to.y - from.y;
-	float deltaDepth = to.depth - from.depth;
 	float numberOfSteps = std::max(abs(deltaX), abs(deltaY));
 	float stepX = deltaX/numberOfSteps;
 	float stepY = deltaY/numberOfSteps;
-	float stepDepth = deltaDepth/numberOfSteps;
-	for (float i = 0; i < numberOfSteps; i++) {
-		float x = from.x + i*stepX;
-		float y = from.y + i*stepY;
-		float depth = from.depth + i*stepDepth;
-		int xInt = round(x);
-		int yInt = round(y);
-		if (1/depth > depthBuffer[yInt][xInt]) {
-			depthBuffer[yInt][xInt] = 1/depth;
-			window.setPixelColour(xInt, yInt, packColour(colour));
-		}
+
+	// clip the line to the canvas so that off-screen sections aren't stepped through pixel by pixel
+	float tStart = 0;
+	float tEnd = 1;
+	float minX = -0.5f, maxX = width - 0.5f, minY = -0.5f, maxY = height - 0.5f;
+	if (!clipLineAgainstBoundary(-deltaX, from.x - minX, tStart, tEnd) ||
+		!clipLineAgainstBoundary(deltaX, maxX - from.x, tStart, tEnd) ||
+		!clipLineAgainstBoundary(-deltaY, from.y - minY, tStart, tEnd) ||
+		!clipLineAgainstBoundary(deltaY, maxY - from.y, tStart, tEnd)) {
+		return;
+	}
+	// snap to whole steps so the pixels visited are the same as for the unclipped line
+	float firstStep = std::ceil(tStart*numberOfSteps);
+	float lastStep = std::min(numberOfSteps, std::floor(tEnd*numberOfSteps) + 1);
+
+	for (float i = firstStep; i < lastStep; i++) {
+		int xInt = round(from.x + i*stepX);
+		int yInt = round(from.y + i*stepY);
+		if (xInt < 0 || xInt >= width || yInt < 0 || yInt >= height) continue;
+		plot(xInt, yInt, i/numberOfSteps);
 	}
 }
 
+void drawLine(DrawingWindow &window, CanvasPoint from, CanvasPoint to, Colour colour) {
+	stepAlongLine(from, to, [&](int x, int y, float t) {
+		float depth = lerp(from.depth, to.depth, t);
+		if (1/depth > depthBuffer[y][x]) {
+			depthBuffer[y][x] = 1/depth;
+			window.setPixelColour(x, y, packColour(colour));
+		}
+	});
+}
+
 void drawUnfilledTriangle(DrawingWindow &window, CanvasTriangle triangle, Colour colour) {
 	drawLine(window, triangle.vertices[0], triangle.vertices[1], colour);
 	drawLine(window, triangle.vertices[1], triangle.vertices[2], colour);
@@ -92,14 +244,15 @@ void drawFilledTriangle(DrawingWindow &window, CanvasTriangle triangle, Colour c
 	CanvasPoint bottom = triangle.vertices[2];
 	CanvasPoint middle2 = lerp(top, bottom, (middle1.y-top.y)/(bottom.y-top.y));
 
-	for (float y = top.y; y < middle1.y; y++) {
+	// only walk the rows that are on the canvas (drawLine clips each row horizontally)
+	for (float y = std::max(top.y, 0.0f); y < std::min(middle1.y, float(HEIGHT)); y++) {
 		float t = (y-top.y)/(middle1.y-top.y);
 		CanvasPoint a = lerp(top, middle1, t);
 		CanvasPoint b = lerp(top, middle2, t);
 		drawLine(window, a, b, colour);
 	}
 
-	for (float y = middle1.y; y < bottom.y; y++) {
+	for (float y = std::max(middle1.y, 0.0f); y < std::min(bottom.y, float(HEIGHT)); y++) {
 		float t = (y-middle1.y)/(bottom.y-middle1.y);
 		CanvasPoint a = lerp(middle1, bottom, t);
 		CanvasPoint b = lerp(middle2, bottom, t);
@@ -109,6 +262,49 @@ void drawFilledTriangle(DrawingWindow &window, CanvasTriangle triangle, Colour c
 	// drawUnfilledTriangle(window, triangle, Colour(255, 255, 255));
 }
 
+// Fills a triangle row by row in the same way as drawFilledTriangle, but rather than drawing each pixel hands it to
+// fragment(x, y, depth, barycentric). barycentric is where the pixel lies within the model triangle, given where
+// each canvas vertex lies in it (so a triangle clipped out of a bigger one still interpolates the original's
+// attributes). It is interpolated along with 1/depth so that it is perspective correct.
+template <typename Fragment>
+void fillTriangle(const CanvasTriangle &triangle, const std::array<glm::vec3, 3> &barycentrics, Fragment fragment,
+		int width = WIDTH, int height = HEIGHT) {
+	// barycentric/depth and 1/depth vary linearly across the canvas, unlike the barycentrics themselves
+	std::array<int, 3> order = {{0, 1, 2}};
+	std::sort(order.begin(), order.end(), [&](int a, int b) { return triangle.vertices[a].y < triangle.vertices[b].y; });
+	std::array<glm::vec4, 3> linear;
+	for (int i = 0; i < 3; i++) {
+		float inverseDepth = 1/triangle.vertices[order[i]].depth;
+		linear[i] = glm::vec4(barycentrics[order[i]] * inverseDepth, inverseDepth);
+	}
+	CanvasPoint top = triangle.vertices[order[0]];
+	CanvasPoint middle1 = triangle.vertices[order[1]];
+	CanvasPoint bottom = triangle.vertices[order[2]];
+	float tMiddle = (middle1.y-top.y)/(bottom.y-top.y);
+	CanvasPoint middle2 = lerp(top, bottom, tMiddle);
+	glm::vec4 linearMiddle2 = glm::mix(linear[0], linear[2], tMiddle);
+
+	auto fillRow = [&](const CanvasPoint &a, const CanvasPoint &b, const glm::vec4 &linearA, const glm::vec4 &linearB) {
+		stepAlongLine(a, b, [&](int x, int y, float t) {
+			glm::vec4 interpolated = glm::mix(linearA, linearB, t);
+			float depth = 1/interpolated.w;
+			fragment(x, y, depth, glm::vec3(interpolated) * depth);
+		}, width, height);
+	};
+
+	for (float y = std::max(top.y, 0.0f); y < std::min(middle1.y, float(height)); y++) {
+		float t = (y-top.y)/(middle1.y-top.y);
+		fillRow(lerp(top, middle1, t), lerp(top, middle2, t),
+			glm::mix(linear[0], linear[1], t), glm::mix(linear[0], linearMiddle2, t));
+	}
+
+	for (float y = std::max(middle1.y, 0.0f); y < std::min(bottom.y, float(height)); y++) {
+		float t = (y-middle1.y)/(bottom.y-middle1.y);
+		fillRow(lerp(middle1, bottom, t), lerp(middle2, bottom, t),
+			glm::mix(linear[1], linear[2], t), glm::mix(linearMiddle2, linear[2], t));
+	}
+}
+
 void drawTexturedTriangle(DrawingWindow &window, CanvasTriangle canvasTriangle, TextureMap textureMap,
 		std::vector<TexturePoint> texturePoints) {
 
@@ -182,135 +378,1450 @@ void drawTexturedTriangle(DrawingWindow &window, CanvasTriangle canvasTriangle,
 	drawUnfilledTriangle(window, canvasTriangle, Colour(255, 255, 255));
 }
 
+// index of the OBJ vertex/texture point referred to by a face element such as "3/" or "3/1", or -1 if it's missing
+int parseFaceIndex(const std::string &element, int which) {
+	std::vector<std::string> indices = split(element, '/');
+	if (which >= int(indices.size()) || indices[which].empty()) return -1;
+	return stoi(indices[which]) - 1;
+}
+
 void readObjFile(std::string fileName, std::vector<ModelTriangle> &triangles, float scale,
-		std::map<std::string, Colour> colours) {
+		const std::vector<Material> &materials) {
 	std::ifstream file(fileName);
 	std::string line;
 	std::vector<glm::vec3> vertices;
-	Colour currentColour;
+	std::vector<TexturePoint> texturePoints;
+	std::vector<glm::vec3> normals;
+	size_t currentMaterial = 0;
+	size_t firstTriangle = triangles.size();
 	while (std::getline(file, line)) {
-		printf("getline");
 		std::vector<std::string> lineSplit = split(line, ' ');
 		if (lineSplit[0] == "v") {
 			vertices.push_back(glm::vec3(stof(lineSplit[1]), stof(lineSplit[2]), stof(lineSplit[3])) * scale);
+		} else if (lineSplit[0] == "vt") {
+			texturePoints.push_back(TexturePoint(stof(lineSplit[1]), stof(lineSplit[2])));
+		} else if (lineSplit[0] == "vn") {
+			normals.push_back(glm::normalize(glm::vec3(stof(lineSplit[1]), stof(lineSplit[2]), stof(lineSplit[3]))));
 		} else if (lineSplit[0] == "f") {
-			triangles.push_back(ModelTriangle(
-				vertices[stoi(lineSplit[1].substr(0, lineSplit[1].length()-1))-1],
-				vertices[stoi(lineSplit[2].substr(0, lineSplit[2].length()-1))-1],
-				vertices[stoi(lineSplit[3].substr(0, lineSplit[3].length()-1))-1],
-				currentColour));
+			ModelTriangle triangle(
+				vertices[parseFaceIndex(lineSplit[1], 0)],
+				vertices[parseFaceIndex(lineSplit[2], 0)],
+				vertices[parseFaceIndex(lineSplit[3], 0)],
+				materials[currentMaterial].colour);
+			for (int i = 0; i < 3; i++) {
+				int textureIndex = parseFaceIndex(lineSplit[i+1], 1);
+				if (textureIndex != -1) triangle.texturePoints[i] = texturePoints[textureIndex];
+				int normalIndex = parseFaceIndex(lineSplit[i+1], 2);
+				if (normalIndex != -1) triangle.vertexNormals[i] = normals[normalIndex];
+			}
+			triangle.normal = glm::normalize(glm::cross(triangle.vertices[1] - triangle.vertices[0],
+				triangle.vertices[2] - triangle.vertices[0]));
+			triangle.materialIndex = currentMaterial;
+			triangles.push_back(triangle);
 		}
 		else if (lineSplit[0] == "usemtl") {
-			currentColour = colours.at(lineSplit[1]);
+			auto material = std::find_if(materials.begin(), materials.end(),
+				[&](const Material &m) { return m.name == lineSplit[1]; });
+			if (material == materials.end()) throw std::invalid_argument("Unknown material `" + lineSplit[1] + "`");
+			currentMaterial = material - materials.begin();
 		}
 	}
+	// done once here so shading never has to work them out
+	computeVertexNormals(triangles, firstTriangle, CREASE_ANGLE);
+	computeTangents(triangles, firstTriangle);
 }
 
-void readMtlFile(std::string fileName, std::map<std::string, Colour> &colours) {
+void readMtlFile(std::string fileName, std::vector<Material> &materials) {
 	std::ifstream file(fileName);
 	std::string line;
-	std::string matName;
+	// texture files are named relative to the MTL file
+	std::string directory = fileName.substr(0, fileName.find_last_of('/') + 1);
 	while (std::getline(file, line)) {
 		std::vector<std::string> lineSplit = split(line, ' ');
 		if (lineSplit[0] == "newmtl") {
-			matName = lineSplit[1];
+			materials.push_back(Material(lineSplit[1], Colour()));
 		} else if (lineSplit[0] == "Kd") {
 			Colour newColour = Colour(
 				int(stof(lineSplit[1])*255),
 				int(stof(lineSplit[2])*255),
 				int(stof(lineSplit[3])*255));
-			newColour.name = matName;
-			colours.insert({matName, newColour});
+			newColour.name = materials.back().name;
+			materials.back().colour = newColour;
+		} else if (lineSplit[0] == "Ns") {
+			materials.back().specularExponent = stof(lineSplit[1]);
+		} else if (lineSplit[0] == "map_Kd") {
+			materials.back().texture = TextureMap(directory + lineSplit[1]);
+		} else if (lineSplit[0] == "norm" || lineSplit[0] == "map_Bump" || lineSplit[0] == "bump") {
+			// the file name comes after any options
+			materials.back().normalMap = NormalMap(TextureMap(directory + lineSplit.back()));
+		} else if (lineSplit[0] == "illum") {
+			// 3 is a raytraced reflection, and 4, 6 and 7 are kinds of glass
+			int illum = stoi(lineSplit[1]);
+			if (illum == 3) materials.back().type = MIRROR;
+			else if (illum == 4 || illum == 6 || illum == 7) materials.back().type = DIELECTRIC;
+		} else if (lineSplit[0] == "Ni") {
+			materials.back().refractiveIndex = stof(lineSplit[1]);
+		} else if (lineSplit[0] == "Pm") {
+			// metallic and roughness are from the PBR extension to MTL
+			if (stof(lineSplit[1]) > 0) materials.back().type = METAL;
+		} else if (lineSplit[0] == "Pr") {
+			materials.back().roughness = stof(lineSplit[1]);
 		}
 	}
 }
 
-CanvasPoint projectVertexOntoCanvasPoint(float focalLength, glm::vec3 vertexPosition,
-		float imagePlaneScale) {
-	glm::vec3 vertexWrtCamera = vertexPosition - cameraPosition;
+CanvasPoint projectCameraSpaceVertex(float focalLength, glm::vec3 vertexWrtCamera, float imagePlaneScale,
+		int width = WIDTH, int height = HEIGHT) {
 	// -vertexWrtCamera.z is the depth as z is pointing out of the screen
 	float u = vertexWrtCamera.x * (focalLength / -vertexWrtCamera.z);
 	// negated because the model uses y pointing up, but the canvas uses y pointing down
 	float v = -vertexWrtCamera.y * (focalLength / -vertexWrtCamera.z);
-	u = u*imagePlaneScale + WIDTH/2;
-	v = v*imagePlaneScale + HEIGHT/2;
+	u = u*imagePlaneScale + width/2;
+	v = v*imagePlaneScale + height/2;
 	return CanvasPoint(u, v, -vertexWrtCamera.z);  // store depth (note: this is not z!)
 }
 
-void drawRasterised(DrawingWindow &window) {
+CanvasPoint projectVertexOntoCanvasPoint(float focalLength, glm::vec3 vertexPosition,
+		float imagePlaneScale) {
+	return projectCameraSpaceVertex(focalLength, vertexPosition - cameraPosition, imagePlaneScale);
+}
+
+// true if the camera is looking at the back of the triangle (vertices wound clockwise on screen)
+bool isBackFacing(const std::array<glm::vec3, 3> &vertexWrtCamera) {
+	glm::vec3 normal = glm::cross(vertexWrtCamera[1] - vertexWrtCamera[0], vertexWrtCamera[2] - vertexWrtCamera[0]);
+	return glm::dot(normal, vertexWrtCamera[0]) >= 0;
+}
+
+// true if all the vertices lie outside the same side of the view frustum, so nothing of the triangle/box can be seen.
+// Triangles only partially off the side of the canvas are kept and clipped to the canvas by the filler (guard band)
+template <size_t N>
+bool isOutsideFrustum(const std::array<glm::vec3, N> &vertexWrtCamera, float focalLength, float imagePlaneScale,
+		int width = WIDTH, int height = HEIGHT) {
+	// half the width/height of the view at a depth of 1
+	float halfWidth = (width/2) / (focalLength*imagePlaneScale);
+	float halfHeight = (height/2) / (focalLength*imagePlaneScale);
+	size_t outsideLeft = 0, outsideRight = 0, outsideTop = 0, outsideBottom = 0, outsideNear = 0;
+	for (const glm::vec3 &vertex : vertexWrtCamera) {
+		float depth = -vertex.z;
+		if (vertex.x < -depth*halfWidth) outsideLeft++;
+		if (vertex.x > depth*halfWidth) outsideRight++;
+		if (vertex.y > depth*halfHeight) outsideTop++;
+		if (vertex.y < -depth*halfHeight) outsideBottom++;
+		if (depth < NEAR_PLANE) outsideNear++;
+	}
+	return outsideLeft == N || outsideRight == N || outsideTop == N || outsideBottom == N || outsideNear == N;
+}
+
+// Sutherland-Hodgman clip of a camera-space triangle against the near plane. Writes the visible polygon
+// (a triangle or quad) to clipped and returns its vertex count, 0 if the triangle is entirely behind the plane.
+// clippedBarycentrics gets where each of the polygon's vertices lies within the original triangle.
+int clipAgainstNearPlane(const std::array<glm::vec3, 3> &vertexWrtCamera, std::array<glm::vec3, 4> &clipped,
+		std::array<glm::vec3, 4> &clippedBarycentrics) {
+	const std::array<glm::vec3, 3> corners = {{glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1)}};
+	int count = 0;
+	for (int i = 0; i < 3; i++) {
+		glm::vec3 current = vertexWrtCamera[i];
+		glm::vec3 next = vertexWrtCamera[(i+1)%3];
+		float currentDistance = -current.z - NEAR_PLANE;
+		float nextDistance = -next.z - NEAR_PLANE;
+		if (currentDistance >= 0) {
+			clippedBarycentrics[count] = corners[i];
+			clipped[count++] = current;
+		}
+		if ((currentDistance >= 0) != (nextDistance >= 0)) {
+			float t = currentDistance / (currentDistance-nextDistance);
+			clippedBarycentrics[count] = glm::mix(corners[i], corners[(i+1)%3], t);
+			clipped[count++] = current + t*(next-current);
+		}
+	}
+	return count;
+}
+
+// A piece of a model triangle ready to be filled: its corners on the canvas and where they are in the model triangle
+struct ProjectedTriangle {
+	CanvasTriangle canvasTriangle;
+	std::array<glm::vec3, 3> barycentrics;
+};
+
+// Culls and clips a triangle and projects what's left of it onto the canvas. Returns how many canvas triangles it
+// became (0 if none of it can be seen)
+int projectTriangle(const ModelTriangle &triangle, float focalLength, float imagePlaneScale,
+		std::array<ProjectedTriangle, 2> &projected) {
+	std::array<glm::vec3, 3> vertexWrtCamera;
+	for (int j = 0; j < 3; j++) {
+		vertexWrtCamera[j] = triangle.vertices[j] - cameraPosition;
+	}
+	if (backfaceCulling && isBackFacing(vertexWrtCamera)) return 0;
+	if (isOutsideFrustum(vertexWrtCamera, focalLength, imagePlaneScale)) return 0;
+
+	// clip before projecting, as vertices behind the camera would be projected inverted
+	std::array<glm::vec3, 4> clipped;
+	std::array<glm::vec3, 4> clippedBarycentrics;
+	int clippedCount = clipAgainstNearPlane(vertexWrtCamera, clipped, clippedBarycentrics);
+	for (int j = 1; j+1 < clippedCount; j++) {
+		projected[j-1].canvasTriangle = CanvasTriangle(
+			projectCameraSpaceVertex(focalLength, clipped[0], imagePlaneScale),
+			projectCameraSpaceVertex(focalLength, clipped[j], imagePlaneScale),
+			projectCameraSpaceVertex(focalLength, clipped[j+1], imagePlaneScale));
+		projected[j-1].barycentrics = {{clippedBarycentrics[0], clippedBarycentrics[j], clippedBarycentrics[j+1]}};
+	}
+	return std::max(clippedCount - 2, 0);
+}
+
+// Projects a triangle and passes the visible pieces of it to draw(triangle, triangleId, projectedTriangle), skipping
+// any that the depth pyramid shows are hidden
+template <typename Draw>
+void rasteriseTriangle(const ModelTriangle &triangle, size_t triangleId, float focalLength, float imagePlaneScale,
+		Draw draw) {
+	std::array<ProjectedTriangle, 2> projected;
+	int projectedCount = projectTriangle(triangle, focalLength, imagePlaneScale, projected);
+	for (int i = 0; i < projectedCount; i++) {
+		const CanvasTriangle &canvasTriangle = projected[i].canvasTriangle;
+		if (!occlusionCulling) {
+			draw(triangle, triangleId, projected[i]);
+			occlusionStats.trianglesDrawn++;
+			continue;
+		}
+
+		// every pixel the filler can touch, and the nearest depth it can write
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearestDepth = FLT_MAX;
+		for (const CanvasPoint &vertex : canvasTriangle.vertices) {
+			minX = std::min(minX, vertex.x);
+			minY = std::min(minY, vertex.y);
+			maxX = std::max(maxX, vertex.x);
+			maxY = std::max(maxY, vertex.y);
+			nearestDepth = std::min(nearestDepth, vertex.depth);
+		}
+		occlusionStats.trianglesTested++;
+		if (depthPyramid.isOccluded(floor(minX), floor(minY), ceil(maxX), ceil(maxY), 1/nearestDepth)) {
+			occlusionStats.trianglesCulled++;
+			continue;
+		}
+		draw(triangle, triangleId, projected[i]);
+		occlusionStats.trianglesDrawn++;
+		depthPyramid.markDirty(floor(minX), floor(minY), ceil(maxX), ceil(maxY));
+	}
+}
+
+// true if the box is entirely outside the view or behind what has already been drawn
+bool isBoxHidden(const Aabb &box, float focalLength, float imagePlaneScale) {
+	std::array<glm::vec3, 8> corners;
+	for (int i = 0; i < 8; i++) {
+		glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+		corners[i] = corner - cameraPosition;
+	}
+	if (isOutsideFrustum(corners, focalLength, imagePlaneScale)) return true;
+
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearestDepth = FLT_MAX;
+	for (const glm::vec3 &corner : corners) {
+		// a box reaching behind the near plane has no sensible bounds on the canvas
+		if (-corner.z < NEAR_PLANE) return false;
+		CanvasPoint projected = projectCameraSpaceVertex(focalLength, corner, imagePlaneScale);
+		minX = std::min(minX, projected.x);
+		minY = std::min(minY, projected.y);
+		maxX = std::max(maxX, projected.x);
+		maxY = std::max(maxY, projected.y);
+		nearestDepth = std::min(nearestDepth, projected.depth);
+	}
+	return depthPyramid.isOccluded(floor(minX), floor(minY), ceil(maxX), ceil(maxY), 1/nearestDepth);
+}
+
+// Number of triangles under a node of the scene BVH, which run from its leftmost leaf's first to its rightmost leaf's
+// last
+uint32_t subtreeTriangleCount(uint32_t nodeIndex) {
+	uint32_t leftmost = nodeIndex;
+	uint32_t rightmost = nodeIndex;
+	while (!sceneBvh.nodes[leftmost].isLeaf()) leftmost = sceneBvh.nodes[leftmost].leftChildOrFirstTriangle;
+	while (!sceneBvh.nodes[rightmost].isLeaf()) rightmost = sceneBvh.nodes[rightmost].leftChildOrFirstTriangle + 1;
+	const BvhNode &last = sceneBvh.nodes[rightmost];
+	return last.leftChildOrFirstTriangle + last.triangleCount - sceneBvh.nodes[leftmost].leftChildOrFirstTriangle;
+}
+
+// Walks the scene BVH nearest child first, so that near geometry is drawn first and whole nodes hidden behind it can
+// be skipped without looking at their triangles
+template <typename Draw>
+void drawBvhFrontToBack(float focalLength, float imagePlaneScale, Draw draw) {
+	std::vector<uint32_t> stack = {0};
+	while (!stack.empty()) {
+		uint32_t nodeIndex = stack.back();
+		const BvhNode &node = sceneBvh.nodes[nodeIndex];
+		stack.pop_back();
+
+		depthPyramid.update(&depthBuffer[0][0]);
+		occlusionStats.nodesTested++;
+		if (isBoxHidden(node.bounds, focalLength, imagePlaneScale)) {
+			occlusionStats.nodesCulled++;
+			uint32_t culledTriangles = subtreeTriangleCount(nodeIndex);
+			occlusionStats.trianglesTested += culledTriangles;
+			occlusionStats.trianglesCulled += culledTriangles;
+			continue;
+		}
+
+		if (node.isLeaf()) {
+			for (uint32_t i = 0; i < node.triangleCount; i++) {
+				uint32_t triangleIndex = sceneBvh.triangleIndices[node.leftChildOrFirstTriangle + i];
+				rasteriseTriangle(triangles[triangleIndex], triangleIndex, focalLength, imagePlaneScale, draw);
+			}
+			continue;
+		}
+
+		uint32_t left = node.leftChildOrFirstTriangle;
+		float leftDistance = glm::length(sceneBvh.nodes[left].bounds.centre() - cameraPosition);
+		float rightDistance = glm::length(sceneBvh.nodes[left + 1].bounds.centre() - cameraPosition);
+		// the nearer child goes on the stack last so it is drawn first
+		if (leftDistance < rightDistance) {
+			stack.push_back(left + 1);
+			stack.push_back(left);
+		} else {
+			stack.push_back(left);
+			stack.push_back(left + 1);
+		}
+	}
+}
+
+// Clears the depth buffer and hands every visible piece of every triangle to draw(triangle, triangleId,
+// projectedTriangle). Triangles of instances are moved into the world as they're drawn, so draw gets a copy.
+template <typename Draw>
+void rasteriseScene(Draw draw) {
+	PROFILE_SCOPE("rasterise");
 	// initialise depth buffer
 	for (size_t y = 0; y < HEIGHT; y++) {
 		for (size_t x = 0; x < WIDTH; x++) {
 			depthBuffer[y][x] = 0;
 		}
 	}
+	depthPyramid.clear();
+
+	float focalLength = 2;
+	float imagePlaneScale = 280;
+
+	if (occlusionCulling && !sceneBvh.nodes.empty()) {
+		drawBvhFrontToBack(focalLength, imagePlaneScale, draw);
+	} else {
+		for (size_t i = 0; i < triangles.size(); i++) {
+			rasteriseTriangle(triangles[i], i, focalLength, imagePlaneScale, draw);
+		}
+	}
 
+	for (size_t i = 0; i < instancedScene.instances.size(); i++) {
+		const MeshInstance &instance = instancedScene.instances[i];
+		size_t meshTriangleCount = instancedScene.meshes[instance.meshIndex].triangles.size();
+		if (occlusionCulling) {
+			depthPyramid.update(&depthBuffer[0][0]);
+			occlusionStats.nodesTested++;
+			if (isBoxHidden(instance.bounds, focalLength, imagePlaneScale)) {
+				occlusionStats.nodesCulled++;
+				occlusionStats.trianglesTested += meshTriangleCount;
+				occlusionStats.trianglesCulled += meshTriangleCount;
+				continue;
+			}
+		}
+		for (size_t j = 0; j < meshTriangleCount; j++) {
+			rasteriseTriangle(instancedScene.worldTriangle(i, j), triangles.size() + instance.firstTriangleId + j,
+				focalLength, imagePlaneScale, draw);
+		}
+	}
+}
+
+void drawWireframe(DrawingWindow &window) {
 	window.clearPixels();
+	rasteriseScene([&](const ModelTriangle &triangle, size_t, const ProjectedTriangle &projected) {
+		drawUnfilledTriangle(window, projected.canvasTriangle, triangle.colour);
+	});
+}
 
-	for (size_t i = 0; i < triangles.size(); i++) {
-		CanvasTriangle canvasTriangle;
-		for (int j = 0; j < 3; j++) {
-			canvasTriangle.vertices[j] = projectVertexOntoCanvasPoint(2, triangles[i].vertices[j], 280);
+void drawRasterised(DrawingWindow &window) {
+	window.clearPixels();
+	rasteriseScene([&](const ModelTriangle &triangle, size_t, const ProjectedTriangle &projected) {
+		drawFilledTriangle(window, projected.canvasTriangle, triangle.colour);
+	});
+}
+
+Colour sampleTexture(const TextureMap &texture, const TexturePoint &texturePoint) {
+	size_t x = std::min(size_t(std::max(0.0f, texturePoint.x * (texture.width-1) + 0.5f)), texture.width-1);
+	size_t y = std::min(size_t(std::max(0.0f, texturePoint.y * (texture.height-1) + 0.5f)), texture.height-1);
+	uint32_t pixel = texture.pixels[y*texture.width + x];
+	return Colour((pixel >> 16) & 0xFF, (pixel >> 8) & 0xFF, pixel & 0xFF);
+}
+
+// Geometry pass for deferred shading: rasterises the scene into the G-buffer without doing any lighting
+void drawGBuffer() {
+	gBuffer.clear();
+	rasteriseScene([&](const ModelTriangle &triangle, size_t, const ProjectedTriangle &projected) {
+		fillTriangle(projected.canvasTriangle, projected.barycentrics, [&](int x, int y, float depth, glm::vec3 barycentric) {
+			if (1/depth <= depthBuffer[y][x]) return;
+			depthBuffer[y][x] = 1/depth;
+			size_t i = y*WIDTH + x;
+			gBuffer.normals[i] = barycentric[0]*triangle.vertexNormals[0] + barycentric[1]*triangle.vertexNormals[1] +
+				barycentric[2]*triangle.vertexNormals[2];
+			gBuffer.tangents[i] = barycentric[0]*triangle.vertexTangents[0] + barycentric[1]*triangle.vertexTangents[1] +
+				barycentric[2]*triangle.vertexTangents[2];
+			gBuffer.materialIndices[i] = triangle.materialIndex;
+			const std::array<TexturePoint, 3> &texturePoints = triangle.texturePoints;
+			gBuffer.texturePoints[i] = TexturePoint(
+				barycentric[0]*texturePoints[0].x + barycentric[1]*texturePoints[1].x + barycentric[2]*texturePoints[2].x,
+				barycentric[0]*texturePoints[0].y + barycentric[1]*texturePoints[1].y + barycentric[2]*texturePoints[2].y);
+		});
+	});
+}
+
+// Renders depth from the light into each face of the shadow cube map. Both sides of triangles are drawn, as the back
+// of an object casts the same shadow as the front
+void drawShadowMap() {
+	PROFILE_SCOPE("shadow map");
+	shadowMap.clear(lightPosition);
+	int resolution = shadowMap.resolution;
+	float focalLength = 1;
+	float imagePlaneScale = resolution / 2.0f;
+
+	for (int face = 0; face < 6; face++) {
+		std::vector<float> &depths = shadowMap.faces[face];
+		auto drawTriangle = [&](const ModelTriangle &triangle) {
+			std::array<glm::vec3, 3> vertexWrtLight;
+			for (int j = 0; j < 3; j++) {
+				vertexWrtLight[j] = ShadowCubeMap::toFaceSpace(face, triangle.vertices[j] - lightPosition);
+			}
+			if (isOutsideFrustum(vertexWrtLight, focalLength, imagePlaneScale, resolution, resolution)) return;
+
+			std::array<glm::vec3, 4> clipped;
+			std::array<glm::vec3, 4> clippedBarycentrics;
+			int clippedCount = clipAgainstNearPlane(vertexWrtLight, clipped, clippedBarycentrics);
+			for (int j = 1; j+1 < clippedCount; j++) {
+				CanvasTriangle canvasTriangle(
+					projectCameraSpaceVertex(focalLength, clipped[0], imagePlaneScale, resolution, resolution),
+					projectCameraSpaceVertex(focalLength, clipped[j], imagePlaneScale, resolution, resolution),
+					projectCameraSpaceVertex(focalLength, clipped[j+1], imagePlaneScale, resolution, resolution));
+				std::array<glm::vec3, 3> barycentrics =
+					{{clippedBarycentrics[0], clippedBarycentrics[j], clippedBarycentrics[j+1]}};
+				fillTriangle(canvasTriangle, barycentrics, [&](int x, int y, float depth, glm::vec3 barycentric) {
+					float &nearest = depths[y*resolution + x];
+					nearest = std::min(nearest, depth);
+				}, resolution, resolution);
+			}
+		};
+		for (const ModelTriangle &triangle : triangles) drawTriangle(triangle);
+		for (size_t i = 0; i < instancedScene.instances.size(); i++) {
+			const InstancedMesh &mesh = instancedScene.meshes[instancedScene.instances[i].meshIndex];
+			for (size_t j = 0; j < mesh.triangles.size(); j++) drawTriangle(instancedScene.worldTriangle(i, j));
 		}
-		drawFilledTriangle(window, canvasTriangle, triangles[i].colour);
 	}
+	shadowMap.isRendered = true;
 }
 
-RayTriangleIntersection getClosestIntersection(glm::vec3 rayStart, glm::vec3 rayDirection) {
+// The render features switched on for this frame (see RenderFeatures.h)
+unsigned frameRenderFeatures() {
+	unsigned features = 0;
+	if (shadowMapping) features |= SHADOW_MAPPING_FEATURE;
+	if (shadingPrecision == FAST_SHADING) features |= FAST_SHADING_FEATURE;
+	for (const Material &material : materials) {
+		if (material.hasTexture() || material.normalMap.isLoaded()) features |= TEXTURE_FEATURE;
+	}
+	if (photonMapping) features |= PHOTON_MAPPING_FEATURE;
+	if (environmentMap.isLoaded()) features |= ENVIRONMENT_MAP_FEATURE;
+	if (rayHeatmap) features |= RAY_HEATMAP_FEATURE;
+	return features;
+}
+
+// Lighting pass for deferred shading: lights each pixel of the G-buffer exactly once, however many triangles were
+// drawn over it, with the rows shared out between threads. The drawn pixels of a row are gathered into batches for
+// the shading kernel, which lights four at a time.
+template <unsigned features>
+struct LightingPass {
+	static const unsigned usedFeatures = SHADOW_MAPPING_FEATURE | FAST_SHADING_FEATURE | TEXTURE_FEATURE;
+	static void run(DrawingWindow &window);
+};
+
+template <unsigned features>
+void LightingPass<features>::run(DrawingWindow &window) {
+	PROFILE_SCOPE("lighting");
+	float focalLength = 2;
+	float imagePlaneScale = 280;
+	ShadingLight light{lightPosition, lightStrength, cameraPosition, ambientLight};
+	const ShadingPrecision precision = features & FAST_SHADING_FEATURE ? FAST_SHADING : EXACT_SHADING;
+
+	parallelFor(HEIGHT, [&](size_t y) {
+		ShadingBatch batch;
+		size_t batchColumns[SHADING_BATCH_SIZE];
+		float brightness[SHADING_BATCH_SIZE];
+		auto shade = [&]() {
+			shadeBatch<precision>(batch, light, brightness);
+			for (size_t j = 0; j < batch.count; j++) {
+				size_t i = y*WIDTH + batchColumns[j];
+				const Material &material = materials[gBuffer.materialIndices[i]];
+				bool textured = (features & TEXTURE_FEATURE) && material.hasTexture();
+				Colour colour = textured ? sampleTexture(material.texture, gBuffer.texturePoints[i]) : material.colour;
+				window.setPixelColour(batchColumns[j], y, packColour(colour, brightness[j]));
+			}
+			batch.count = 0;
+		};
+
+		for (size_t x = 0; x < WIDTH; x++) {
+			size_t i = y*WIDTH + x;
+			if (gBuffer.materialIndices[i] == NO_MATERIAL) {
+				window.setPixelColour(x, y, 0);
+				continue;
+			}
+			const Material &material = materials[gBuffer.materialIndices[i]];
+
+			// undo the projection to get back to the point on the surface
+			float depth = 1/depthBuffer[y][x];
+			glm::vec3 vertexWrtCamera(
+				(float(x) - WIDTH/2) * depth / (focalLength*imagePlaneScale),
+				-(float(y) - HEIGHT/2) * depth / (focalLength*imagePlaneScale),
+				-depth);
+			glm::vec3 point = vertexWrtCamera + cameraPosition;
+
+			// left for the kernel to normalise, unless the normal map needs it first
+			glm::vec3 normal = gBuffer.normals[i];
+			if ((features & TEXTURE_FEATURE) && material.normalMap.isLoaded()) {
+				normal = material.normalMap.perturb(glm::normalize(normal), gBuffer.tangents[i],
+					gBuffer.texturePoints[i]);
+			}
+			float lightVisibility = features & SHADOW_MAPPING_FEATURE ?
+				shadowMap.visibility(point, normal, shadowFilterRadius) : 1;
+			batchColumns[batch.count] = x;
+			batch.add(point, normal, material.specularExponent, lightVisibility);
+			if (batch.isFull()) shade();
+		}
+		if (batch.count > 0) shade();
+	});
+}
+
+const auto lightingPasses = featureDispatchTable<LightingPass>();
+
+void drawDeferred(DrawingWindow &window) {
+	// the scene doesn't move, so the shadow map only needs redrawing when the light does
+	if (shadowMapping && (!shadowMap.isRendered || shadowMap.lightPosition != lightPosition)) drawShadowMap();
+	drawGBuffer();
+	lightingPasses[frameRenderFeatures()](window);
+}
+
+// Looks for a triangle of meshTriangles (with bvh over them) that the ray hits nearer than closestDistance. Returns
+// true if it finds one, having set closestDistance and closestIndex to the nearest.
+bool intersectTriangles(const Bvh &bvh, const std::vector<ModelTriangle> &meshTriangles, const glm::vec3 &rayStart,
+		const glm::vec3 &rayDirection, float &closestDistance, int &closestIndex, RayStats &stats) {
+	bool isHit = false;
+	traverseBvh(bvh, rayStart, rayDirection, closestDistance, stats, [&](const BvhNode &node, float &nearest) {
+		isHit |= intersectLeafTriangles(bvh.triangleIndices, node.leftChildOrFirstTriangle, node.triangleCount,
+			meshTriangles, rayStart, rayDirection, nearest, closestIndex, stats);
+	});
+	return isHit;
+}
+
+// The same through the wide BVH made from bvh
+bool intersectTriangles(const WideBvh &bvh, const std::vector<ModelTriangle> &meshTriangles,
+		const glm::vec3 &rayStart, const glm::vec3 &rayDirection, float &closestDistance, int &closestIndex,
+		RayStats &stats) {
+	bool isHit = false;
+	traverseWideBvh(bvh, rayStart, rayDirection, closestDistance, stats, [&](uint32_t first, uint32_t count,
+			float &nearest) {
+		isHit |= intersectLeafTriangles(bvh.triangleIndices, first, count, meshTriangles, rayStart, rayDirection,
+			nearest, closestIndex, stats);
+	});
+	return isHit;
+}
+
+// A triangle of the scene, in world space, by its ID: an index into triangles, or beyond them, the ID of a triangle
+// of an instance plus triangles.size()
+ModelTriangle sceneTriangle(size_t triangleId) {
+	if (triangleId < triangles.size()) return triangles[triangleId];
+	uint32_t instancedId = triangleId - triangles.size();
+	size_t instance = instancedScene.instanceOf(instancedId);
+	return instancedScene.worldTriangle(instance, instancedId - instancedScene.instances[instance].firstTriangleId);
+}
+
+// Where a ray hit the scene, without the copy of the triangle a RayTriangleIntersection carries: the distance along
+// it, and an index into triangles or, if instance isn't -1, into that instance's mesh's triangles. index is -1 for a
+// miss.
+struct SceneHit {
+	float distance;
+	int index;
+	int instance;
+
+	SceneHit() : distance(-1), index(-1), instance(-1) {}
+	SceneHit(float hitDistance, int hitIndex, int hitInstance) :
+			distance(hitDistance), index(hitIndex), instance(hitInstance) {}
+};
+
+// Bounds of everything in the scene: the triangles and the instances
+Aabb sceneBounds() {
+	Aabb bounds;
+	if (!sceneBvh.nodes.empty()) bounds.grow(sceneBvh.nodes[0].bounds);
+	if (!instancedScene.topLevel.nodes.empty()) bounds.grow(instancedScene.topLevel.nodes[0].bounds);
+	return bounds;
+}
+
+// What getClosestIntersection returns for a hit
+RayTriangleIntersection sceneIntersection(const glm::vec3 &rayStart, const glm::vec3 &rayDirection,
+		const SceneHit &hit) {
+	if (hit.index == -1) return RayTriangleIntersection(glm::vec3(), -1, ModelTriangle(), -1);
+	glm::vec3 intersectionPoint = rayStart + hit.distance*rayDirection;
+	if (hit.instance == -1) {
+		return RayTriangleIntersection(intersectionPoint, hit.distance, triangles[hit.index], hit.index);
+	}
+	ModelTriangle triangle = instancedScene.worldTriangle(hit.instance, hit.index);
+	uint32_t triangleId = triangles.size() + instancedScene.instances[hit.instance].firstTriangleId + hit.index;
+	return RayTriangleIntersection(intersectionPoint, hit.distance, triangle, triangleId);
+}
+
+// Finds the nearest triangle the ray hits (within maxDistance), among the triangles and then the instances. Rays go
+// through an instance's mesh in its object space. The direction isn't normalised after moving it there, so distances
+// along the ray are the same in both spaces.
+SceneHit closestHit(const glm::vec3 &rayStart, const glm::vec3 &rayDirection, RayType type, RayStats &stats,
+		float maxDistance = FLT_MAX) {
+	if (type == PRIMARY_RAY) stats.primaryRays++;
+	else if (type == SECONDARY_RAY) stats.secondaryRays++;
+	else stats.shadowRays++;
 	int i_closest = -1;
-	float t_closest = FLT_MAX;
+	float t_closest = maxDistance;
+	if (wideBvhTraversal) {
+		intersectTriangles(sceneWideBvh, triangles, rayStart, rayDirection, t_closest, i_closest, stats);
+	} else {
+		intersectTriangles(sceneBvh, triangles, rayStart, rayDirection, t_closest, i_closest, stats);
+	}
 
-	for (int i = 0; i < triangles.size(); i++) {
-		ModelTriangle triangle = triangles[i];
-		glm::vec3 e0 = triangle.vertices[1] - triangle.vertices[0];
-		glm::vec3 e1 = triangle.vertices[2] - triangle.vertices[0];
-		glm::vec3 SPVector = rayStart - triangle.vertices[0];
-		glm::mat3 DEMatrix(-rayDirection, e0, e1);
-		glm::vec3 possibleSolution = inverse(DEMatrix) * SPVector;
-		float t = possibleSolution[0];
-		float u = possibleSolution[1];
-		float v = possibleSolution[2];
-		if (t > 0 && u >= 0 && u <= 1 && v >= 0 && v <= 1 && u + v <= 1 && t > 0.001 && t < t_closest) {
-			i_closest = i;
-			t_closest = t;
+	int closestInstance = -1;
+	const Bvh &topLevel = instancedScene.topLevel;
+	traverseBvh(topLevel, rayStart, rayDirection, t_closest, stats, [&](const BvhNode &node, float &nearest) {
+		for (uint32_t j = 0; j < node.triangleCount; j++) {
+			uint32_t i = topLevel.triangleIndices[node.leftChildOrFirstTriangle + j];
+			const MeshInstance &instance = instancedScene.instances[i];
+			const InstancedMesh &mesh = instancedScene.meshes[instance.meshIndex];
+			glm::vec3 objectStart(instance.worldToObject * glm::vec4(rayStart, 1));
+			glm::vec3 objectDirection(instance.worldToObject * glm::vec4(rayDirection, 0));
+			bool isHit = wideBvhTraversal ?
+				intersectTriangles(mesh.wideBvh, mesh.triangles, objectStart, objectDirection, nearest, i_closest,
+					stats) :
+				intersectTriangles(mesh.bvh, mesh.triangles, objectStart, objectDirection, nearest, i_closest, stats);
+			if (isHit) closestInstance = i;
 		}
+	});
+
+	if (i_closest == -1) return SceneHit();
+	stats.hits++;
+	return SceneHit{t_closest, i_closest, closestInstance};
+}
+
+RayTriangleIntersection getClosestIntersection(glm::vec3 rayStart, glm::vec3 rayDirection, RayType type,
+		RayStats &stats, float maxDistance = FLT_MAX) {
+	return sceneIntersection(rayStart, rayDirection, closestHit(rayStart, rayDirection, type, stats, maxDistance));
+}
+
+// closestHit for each primary ray of a packet, into the ray's lane of hits. The packet goes through the instances'
+// meshes moved into their object spaces, as single rays do.
+void closestPacketHits(RayPacket &packet, std::array<SceneHit, PACKET_SIZE> &hits, RayStats &stats) {
+	intersectPacket(sceneBvh, triangles, packet, stats);
+
+	std::array<int, PACKET_SIZE> closestInstances;
+	closestInstances.fill(-1);
+	const Bvh &topLevel = instancedScene.topLevel;
+	// the whole packet goes through each instance the frustum reaches, as the meshes have BVHs of their own
+	traversePacket(topLevel, packet, stats, 0, [&](const BvhNode &node, unsigned) {
+		for (uint32_t j = 0; j < node.triangleCount; j++) {
+			uint32_t i = topLevel.triangleIndices[node.leftChildOrFirstTriangle + j];
+			const MeshInstance &instance = instancedScene.instances[i];
+			const InstancedMesh &mesh = instancedScene.meshes[instance.meshIndex];
+			RayPacket local = packet.transformed(instance.worldToObject);
+			unsigned localHits = intersectPacket(mesh.bvh, mesh.triangles, local, stats);
+			for (int lane = 0; lane < PACKET_SIZE; lane++) {
+				if (!(localHits & (1u << lane))) continue;
+				packet.closestDistances[lane] = local.closestDistances[lane];
+				packet.closestIndices[lane] = local.closestIndices[lane];
+				closestInstances[lane] = i;
+			}
+		}
+	}, [](uint32_t, unsigned) {});
+
+	for (int lane = 0; lane < PACKET_SIZE; lane++) {
+		if (packet.closestDistances[lane] < 0) continue;  // not in use
+		stats.primaryRays++;
+		hits[lane] = SceneHit();
+		if (packet.closestIndices[lane] == -1) continue;
+		stats.hits++;
+		hits[lane] = SceneHit{packet.closestDistances[lane], packet.closestIndices[lane], closestInstances[lane]};
+	}
+}
+
+bool isPointInShadow(glm::vec3 point, glm::vec3 lightPoint, RayStats &stats) {
+	glm::vec3 rayDirection = normalize(lightPoint - point);
+	// anything hit before reaching the light casts a shadow
+	RayTriangleIntersection intersection = getClosestIntersection(point, rayDirection, SHADOW_RAY, stats,
+		length(lightPoint - point));
+	return intersection.triangleIndex != -1;
+}
+
+// Fraction of the light that reaches a point, with more shadow rays in penumbrae (see lightVisibility)
+float lightVisibilityAt(glm::vec3 point, uint32_t seed, RayStats &stats) {
+	return lightVisibility(areaLight, lightPosition, [&](const glm::vec3 &lightPoint) {
+		return isPointInShadow(point, lightPoint, stats);
+	}, penumbraGridSize, seed);
+}
+
+// A photon on its way through the scene
+struct PhotonPath {
+	glm::vec3 origin;
+	glm::vec3 direction;
+	glm::vec3 power;
+	uint32_t seed;
+};
+
+// The ith photon, as it leaves the light
+PhotonPath emittedPhoton(size_t i) {
+	uint32_t seed = sampleHash(uint32_t(i));
+	glm::vec3 origin = areaLight.pointOnLight(lightPosition, unitFloat(seed), unitFloat(sampleHash(seed)));
+	glm::vec3 direction = uniformSphereDirection(sampleHash(seed + 1));
+	return PhotonPath{origin, direction, glm::vec3(lightStrength / photonCount), seed};
+}
+
+// What happens to a photon at the surface it hit on its depth'th bounce. It's stored where it lands on a diffuse
+// surface after at least one bounce. Diffuse bounces carry on by Russian roulette, with the chance of the surface's
+// average reflectance, so every stored photon has about the same power. Returns false if the photon is absorbed, or
+// true having sent it on from the surface.
+bool scatterPhoton(const RayTriangleIntersection &intersection, int depth, PhotonPath &photon,
+		std::vector<Photon> &stored) {
+	const ModelTriangle &triangle = intersection.intersectedTriangle;
+	const Material &material = materials[triangle.materialIndex];
+	glm::vec3 reflectance(triangle.colour.red, triangle.colour.green, triangle.colour.blue);
+	reflectance /= 255.0f;
+	photon.seed = sampleHash(photon.seed + depth + 2);
+	photon.origin = intersection.intersectionPoint;
+
+	if (material.type == DIFFUSE) {
+		if (depth > 0) stored.push_back(Photon{photon.origin, photon.power, photon.direction, 0});
+		float survival = (reflectance.r + reflectance.g + reflectance.b) / 3;
+		if (unitFloat(photon.seed) >= survival) return false;
+		photon.power *= reflectance / survival;
+		glm::vec3 normal = glm::dot(photon.direction, triangle.normal) < 0 ? triangle.normal : -triangle.normal;
+		photon.direction = cosineHemisphereDirection(normal, sampleHash(photon.seed));
+	} else if (material.type == MIRROR) {
+		photon.direction = glm::reflect(photon.direction, triangle.normal);
+	} else if (material.type == METAL) {
+		glm::vec3 reflected = glossyReflection(glm::reflect(photon.direction, triangle.normal), material.roughness,
+			photon.seed);
+		if (glm::dot(reflected, triangle.normal) * glm::dot(photon.direction, triangle.normal) >= 0) return false;
+		photon.direction = reflected;
+		photon.power *= reflectance;
+	} else {
+		// one photon can't split, so it picks reflection or refraction in proportion
+		glm::vec3 reflected;
+		glm::vec3 refracted;
+		float fraction = dielectricDirections(photon.direction, triangle.normal, material.refractiveIndex, reflected,
+			refracted);
+		photon.direction = unitFloat(photon.seed) < fraction ? reflected : refracted;
 	}
+	return true;
+}
 
-	if (i_closest == -1) {
-		return RayTriangleIntersection(glm::vec3(), -1, ModelTriangle(), -1);
+// Follows photons from the light through the scene and builds the photon map from where they're stored. Photons are
+// followed one at a time on every thread or, with rayStreaming, all together a bounce at a time, with each bounce's
+// rays traced as a RayStream. Each photon takes the same path either way, but they're stored in a different order.
+void emitPhotons() {
+	PROFILE_SCOPE("photons");
+	std::vector<Photon> photons;
+	if (rayStreaming) {
+		RayStats stats;  // photon rays aren't part of any frame's ray counts
+		Aabb bounds = sceneBounds();
+		std::vector<PhotonPath> paths(photonCount);
+		for (size_t i = 0; i < photonCount; i++) paths[i] = emittedPhoton(i);
+		for (int depth = 0; depth <= maxRayDepth && !paths.empty(); depth++) {
+			RayStream stream;
+			stream.rays.reserve(paths.size());
+			for (const PhotonPath &path : paths) stream.add(path.origin, path.direction);
+			std::vector<SceneHit> hits;
+			stream.trace(bounds, hits, stats, [](const StreamRay &ray, RayStats &rayStats) {
+				return closestHit(ray.origin, ray.direction, SECONDARY_RAY, rayStats);
+			});
+			std::vector<PhotonPath> bounced;
+			for (size_t i = 0; i < paths.size(); i++) {
+				if (hits[i].index == -1) continue;
+				PhotonPath path = paths[i];
+				RayTriangleIntersection intersection = sceneIntersection(path.origin, path.direction, hits[i]);
+				if (scatterPhoton(intersection, depth, path, photons)) bounced.push_back(path);
+			}
+			paths.swap(bounced);
+		}
+	} else {
+		const size_t batchCount = 256;
+		std::vector<std::vector<Photon>> batches(batchCount);
+		parallelFor(batchCount, [&](size_t batch) {
+			RayStats stats;
+			for (size_t i = batch; i < photonCount; i += batchCount) {
+				PhotonPath path = emittedPhoton(i);
+				for (int depth = 0; depth <= maxRayDepth; depth++) {
+					RayTriangleIntersection intersection = getClosestIntersection(path.origin, path.direction,
+						SECONDARY_RAY, stats);
+					if (intersection.triangleIndex == -1 || !scatterPhoton(intersection, depth, path, batches[batch])) {
+						break;
+					}
+				}
+			}
+		});
+		for (const std::vector<Photon> &batch : batches) photons.insert(photons.end(), batch.begin(), batch.end());
 	}
 
-	ModelTriangle triangle = triangles[i_closest];
-	glm::vec3 intersectionPoint = cameraPosition + t_closest*rayDirection;
-	return RayTriangleIntersection(intersectionPoint, t_closest, triangle, i_closest);
+	photonMap = PhotonMap(std::move(photons));
+	photonMap.lightPosition = lightPosition;
+	photonMap.isBuilt = true;
 }
 
-bool isPointInShadow(glm::vec3 point) {
-	glm::vec3 rayDirection = normalize(lightPosition - point);
-	RayTriangleIntersection intersection = getClosestIntersection(point, rayDirection);
-	return intersection.triangleIndex != -1 && intersection.distanceFromCamera < length(lightPosition - point);
+// Loads an environment map for the ray tracer, telling the layout from the shape of the image: 2:1 for latitude and
+// longitude, or a 4:3 cube cross
+void loadEnvironmentMap(const std::string &fileName) {
+	TextureMap image(fileName);
+	environmentMap = EnvironmentMap(image, image.width == 2*image.height ? EQUIRECTANGULAR : CUBE_CROSS);
 }
 
-void draw(DrawingWindow &window) {
-	window.clearPixels();
+// The ith of environmentLightAt's directions from a surface with this normal, and what the light from the map along
+// it is weighted by in the estimate: 0 for a direction below the surface, which is skipped
+float environmentSample(const glm::vec3 &normal, uint32_t seed, int i, glm::vec3 &direction) {
+	uint32_t sampleSeed = sampleHash(seed + i);
+	if (i % 2 == 0) {
+		float mapPdf;
+		direction = environmentMap.sampleDirection(unitFloat(sampleSeed), unitFloat(sampleHash(sampleSeed)), mapPdf);
+	} else {
+		direction = cosineHemisphereDirection(normal, sampleSeed);
+	}
+	float cosine = glm::dot(direction, normal);
+	if (cosine <= 0) return 0;
+	float pdf = (environmentMap.pdf(direction) + cosine / float(M_PI)) / 2;
+	// a diffuse surface reflects 1/pi of the light arriving per unit area in each direction
+	return cosine / pdf / float(environmentSamples * M_PI);
+}
+
+// Light from the environment map reflected by a diffuse surface, as a multiple of its colour. A Monte Carlo estimate
+// with a shadow ray per direction, taking directions alternately in proportion to how bright the map is and to the
+// cosine with the normal. Weighting each by the mixture of both probabilities (the balance heuristic) keeps the
+// estimate low-noise both for small bright lights and for dim, even skies.
+glm::vec3 environmentLightAt(glm::vec3 point, glm::vec3 normal, uint32_t seed, RayStats &stats) {
+	glm::vec3 total(0);
+	for (int i = 0; i < environmentSamples; i++) {
+		glm::vec3 direction;
+		float weight = environmentSample(normal, seed, i, direction);
+		if (weight == 0 || closestHit(point, direction, SHADOW_RAY, stats).index != -1) continue;
+		total += environmentMap.lookup(direction) / 255.0f * weight;
+	}
+	return total;
+}
+
+// A reflected or refracted ray waiting to be traced, and how much of what it sees reaches the pixel
+struct PendingRay {
+	glm::vec3 origin;
+	glm::vec3 direction;
+	glm::vec3 throughput;
+	int depth;
+	float roughness;  // of the surface it was reflected by, for blurring the environment map
+};
+
+// Direction of the primary ray through a point on the canvas (in pixels)
+glm::vec3 primaryRayDirection(float x, float y) {
+	float focalLength = 2;
+	float imagePlaneScale = 280;
+
+	float u = (x - WIDTH/2) / imagePlaneScale;
+	float v = -(y - HEIGHT/2) / imagePlaneScale;
+	glm::vec3 cameraToImagePlanePixel = glm::vec3(u, v, -focalLength);
+	return normalize(cameraToImagePlanePixel * cameraOrientation);
+}
+
+// Seed for the random numbers along the paths from a point on the canvas (in pixels)
+uint32_t pixelSeed(float x, float y) {
+	return sampleHash(uint32_t((x + 1) * 256) * 73856093u ^ uint32_t((y + 1) * 256) * 19349663u);
+}
+
+// Whether a ray is too deep or would add too little to its pixel to be worth tracing (see maxRayDepth and
+// minRayThroughput)
+bool isRayNegligible(const PendingRay &ray) {
+	float strongest = std::max(ray.throughput.r, std::max(ray.throughput.g, ray.throughput.b));
+	return ray.depth > maxRayDepth || strongest < minRayThroughput;
+}
+
+// Records where a pixel's primary ray hit, for reprojecting it into later frames
+void recordPrimaryHit(CachedPixel &pixel, const RayTriangleIntersection &intersection) {
+	pixel.hitPosition = intersection.intersectionPoint;
+	// reflections and refractions change with the view, and diffuse surfaces don't
+	pixel.isReusable = materials[intersection.intersectedTriangle.materialIndex].type == DIFFUSE;
+}
+
+// What a ray does at the surface it hit. A diffuse surface gets lightDiffuse(point, normal, tint), with the normal
+// turned to face the ray and tint the ray's throughput times the surface's colour, which the light reaching the
+// point is scaled by. Other materials send the ray on, reflected or refracted, with push(ray).
+template <typename LightDiffuse, typename Push>
+void scatterRay(const PendingRay &ray, const RayTriangleIntersection &intersection, uint32_t raySeed,
+		LightDiffuse lightDiffuse, Push push) {
+	const ModelTriangle &triangle = intersection.intersectedTriangle;
+	const Material &material = materials[triangle.materialIndex];
+	glm::vec3 point = intersection.intersectionPoint;
+	glm::vec3 surfaceColour(triangle.colour.red, triangle.colour.green, triangle.colour.blue);
+	auto send = [&](const glm::vec3 &direction, const glm::vec3 &throughput) {
+		float roughness = material.type == METAL ? material.roughness : 0;
+		push(PendingRay{point, direction, throughput, ray.depth + 1, roughness});
+	};
+
+	if (material.type == DIFFUSE) {
+		glm::vec3 normal = glm::dot(ray.direction, triangle.normal) < 0 ? triangle.normal : -triangle.normal;
+		lightDiffuse(point, normal, ray.throughput * surfaceColour);
+	} else if (material.type == MIRROR) {
+		send(glm::reflect(ray.direction, triangle.normal), ray.throughput);
+	} else if (material.type == METAL) {
+		glm::vec3 direction = glossyReflection(glm::reflect(ray.direction, triangle.normal), material.roughness,
+			raySeed);
+		// scattered into the surface is absorbed
+		bool outwards = glm::dot(direction, triangle.normal) * glm::dot(ray.direction, triangle.normal) < 0;
+		if (outwards) send(direction, ray.throughput * surfaceColour / 255.0f);
+	} else {
+		glm::vec3 reflected;
+		glm::vec3 refracted;
+		float reflectance = dielectricDirections(ray.direction, triangle.normal, material.refractiveIndex, reflected,
+			refracted);
+		send(reflected, ray.throughput * reflectance);
+		if (reflectance < 1) send(refracted, ray.throughput * (1 - reflectance));
+	}
+}
+
+// Traces a primary ray through a point on the canvas (in pixels), and from wherever it hits, a shadow ray for a
+// diffuse surface or the reflected and refracted rays for other materials. Rays wait on a stack rather than being
+// traced recursively, so the cost of a path is bounded by maxRayDepth and minRayThroughput. Where the primary ray
+// hit goes in primaryHit, if given. If the primary ray has already been traced (in a packet), tracedPrimary is what
+// it hit.
+template <unsigned features>
+PixelSample traceSample(float x, float y, RayStats &stats, CachedPixel *primaryHit = nullptr,
+		const SceneHit *tracedPrimary = nullptr) {
+	glm::vec3 rayDirection = primaryRayDirection(x, y);
+	uint32_t seed = pixelSeed(x, y);
+
+	PixelSample sample{NO_TRIANGLE, 0};
+	glm::vec3 colour(0);
+	std::array<PendingRay, 32> stack;  // deep enough for two rays per bounce along the deepest path
+	size_t stackSize = 0;
+	uint32_t raysTraced = 0;
+	stack[stackSize++] = PendingRay{cameraPosition, rayDirection, glm::vec3(1), 0, 0};
+	while (stackSize > 0) {
+		PendingRay ray = stack[--stackSize];
+		RayTriangleIntersection intersection = ray.depth == 0 && tracedPrimary ?
+			sceneIntersection(ray.origin, ray.direction, *tracedPrimary) :
+			getClosestIntersection(ray.origin, ray.direction, ray.depth == 0 ? PRIMARY_RAY : SECONDARY_RAY, stats);
+		uint32_t raySeed = sampleHash(seed + raysTraced++);
+		if (ray.depth == 0 && intersection.triangleIndex != -1) sample.triangleIndex = intersection.triangleIndex;
+		if (intersection.triangleIndex == -1) {
+			if (features & ENVIRONMENT_MAP_FEATURE) {
+				colour += ray.throughput * environmentMap.lookup(ray.direction, ray.roughness);
+			}
+			continue;
+		}
+		if (ray.depth == 0 && primaryHit) recordPrimaryHit(*primaryHit, intersection);
+
+		auto lightDiffuse = [&](const glm::vec3 &point, const glm::vec3 &normal, const glm::vec3 &tint) {
+			glm::vec3 light(lightVisibilityAt(point, raySeed, stats));
+			if (features & PHOTON_MAPPING_FEATURE) {
+				light += photonMap.irradiance(point, normal, photonGatherCount, photonGatherRadius);
+			}
+			if (features & ENVIRONMENT_MAP_FEATURE) {
+				light += environmentLightAt(point, normal, sampleHash(raySeed), stats);
+			}
+			colour += tint * light;
+		};
+		scatterRay(ray, intersection, raySeed, lightDiffuse, [&](const PendingRay &next) {
+			if (!isRayNegligible(next) && stackSize < stack.size()) stack[stackSize++] = next;
+		});
+	}
+	colour = glm::min(colour, glm::vec3(255));
+	sample.colour = packColour(Colour(colour.r, colour.g, colour.b));
+	return sample;
+}
+
+// A ray of a pixel's path, in a wave of traceStreamedSamples
+struct StreamedRay {
+	size_t pixel;
+	PendingRay ray;
+	uint32_t rayNumber;  // where traceSample would trace it among the pixel's rays, which picks its seed
+};
+
+// A diffuse surface a streamed ray hit, waiting to be lit
+struct StreamedDiffuseHit {
+	size_t pixel;
+	glm::vec3 point;
+	glm::vec3 normal;
+	glm::vec3 tint;  // what the light reaching the point is scaled by for the pixel (see scatterRay)
+	uint32_t seed;
+};
+
+// Adds the light reaching each of a wave's diffuse hits to its pixel's colour, as traceSample does, with the shadow
+// rays of lightVisibilityAt and environmentLightAt traced as RayStreams: to the light's corners from every hit
+// first, then to the penumbra grid from the hits whose corners disagree.
+template <unsigned features>
+void lightStreamedHits(const std::vector<StreamedDiffuseHit> &hits, const Aabb &bounds,
+		std::vector<glm::vec3> &colours, RayStats &stats) {
+	auto isOccluded = [](const StreamRay &ray, RayStats &rayStats) {
+		return uint8_t(closestHit(ray.origin, ray.direction, SHADOW_RAY, rayStats, ray.maxDistance).index != -1);
+	};
+	// as isPointInShadow
+	auto addShadowRay = [](RayStream &stream, const glm::vec3 &point, const glm::vec3 &lightPoint) {
+		stream.add(point, normalize(lightPoint - point), length(lightPoint - point));
+	};
+
+	int corners = areaLight.cornerCount();
+	RayStream cornerRays;
+	cornerRays.rays.reserve(hits.size() * corners);
+	for (const StreamedDiffuseHit &hit : hits) {
+		for (int corner = 0; corner < corners; corner++) {
+			addShadowRay(cornerRays, hit.point, areaLight.cornerPoint(lightPosition, corner));
+		}
+	}
+	std::vector<uint8_t> isCornerOccluded;
+	cornerRays.trace(bounds, isCornerOccluded, stats, isOccluded);
 
+	int gridRays = penumbraGridSize*penumbraGridSize;
+	std::vector<float> visibilities(hits.size());
+	std::vector<size_t> penumbraHits;
+	RayStream penumbraRays;
+	for (size_t k = 0; k < hits.size(); k++) {
+		int unoccluded = 0;
+		for (int corner = 0; corner < corners; corner++) {
+			if (!isCornerOccluded[k*corners + corner]) unoccluded++;
+		}
+		if (unoccluded == 0 || unoccluded == corners) {
+			visibilities[k] = float(unoccluded) / corners;
+			continue;
+		}
+		penumbraHits.push_back(k);
+		for (int i = 0; i < gridRays; i++) {
+			addShadowRay(penumbraRays, hits[k].point,
+				penumbraPoint(areaLight, lightPosition, penumbraGridSize, i, hits[k].seed));
+		}
+	}
+	std::vector<uint8_t> isGridOccluded;
+	penumbraRays.trace(bounds, isGridOccluded, stats, isOccluded);
+	for (size_t j = 0; j < penumbraHits.size(); j++) {
+		int unoccluded = 0;
+		for (int i = 0; i < gridRays; i++) {
+			if (!isGridOccluded[j*gridRays + i]) unoccluded++;
+		}
+		visibilities[penumbraHits[j]] = float(unoccluded) / gridRays;
+	}
+
+	std::vector<glm::vec3> environmentLight;
+	if (features & ENVIRONMENT_MAP_FEATURE) {
+		environmentLight.assign(hits.size(), glm::vec3(0));
+		RayStream environmentRays;
+		std::vector<size_t> rayHits;
+		std::vector<float> weights;
+		for (size_t k = 0; k < hits.size(); k++) {
+			for (int i = 0; i < environmentSamples; i++) {
+				glm::vec3 direction;
+				float weight = environmentSample(hits[k].normal, sampleHash(hits[k].seed), i, direction);
+				if (weight == 0) continue;
+				environmentRays.add(hits[k].point, direction);
+				rayHits.push_back(k);
+				weights.push_back(weight);
+			}
+		}
+		std::vector<uint8_t> isSkyOccluded;
+		environmentRays.trace(bounds, isSkyOccluded, stats, isOccluded);
+		for (size_t r = 0; r < environmentRays.size(); r++) {
+			if (isSkyOccluded[r]) continue;
+			environmentLight[rayHits[r]] += environmentMap.lookup(environmentRays.rays[r].direction) / 255.0f *
+				weights[r];
+		}
+	}
+
+	for (size_t k = 0; k < hits.size(); k++) {
+		const StreamedDiffuseHit &hit = hits[k];
+		glm::vec3 light(visibilities[k]);
+		if (features & PHOTON_MAPPING_FEATURE) {
+			light += photonMap.irradiance(hit.point, hit.normal, photonGatherCount, photonGatherRadius);
+		}
+		if (features & ENVIRONMENT_MAP_FEATURE) light += environmentLight[k];
+		colours[hit.pixel] += hit.tint * light;
+	}
+}
+
+// traceSample for many pixels together, a wave of rays at a time instead of a path at a time. Each wave's diffuse
+// hits are lit by lightStreamedHits, and the rays the others send on are traced as a RayStream to make the next
+// wave. primaryHits has what each pixel's primary ray hit. Rays get the seeds traceSample would give them, except
+// where glass splits a path: traceSample numbers the second ray after all of the first one's path, which isn't
+// known yet, so paths through glass get different noise.
+template <unsigned features>
+void traceStreamedSamples(const std::vector<size_t> &pixelIndices, const std::vector<SceneHit> &primaryHits,
+		std::vector<CachedPixel> &pixels, RayStats &stats) {
+	Aabb bounds = sceneBounds();
+	std::vector<glm::vec3> colours(pixels.size());
+	std::vector<StreamedRay> wave;
+	for (size_t pixel : pixelIndices) {
+		glm::vec3 direction = primaryRayDirection(pixel % WIDTH, pixel / WIDTH);
+		wave.push_back(StreamedRay{pixel, PendingRay{cameraPosition, direction, glm::vec3(1), 0, 0}, 0});
+		pixels[pixel].sample = PixelSample{NO_TRIANGLE, 0};
+	}
+
+	std::vector<SceneHit> hits = primaryHits;
+	while (!wave.empty()) {
+		std::vector<StreamedRay> nextWave;
+		RayStream nextRays;
+		std::vector<StreamedDiffuseHit> diffuseHits;
+		for (size_t k = 0; k < wave.size(); k++) {
+			const StreamedRay &streamed = wave[k];
+			const PendingRay &ray = streamed.ray;
+			RayTriangleIntersection intersection = sceneIntersection(ray.origin, ray.direction, hits[k]);
+			if (intersection.triangleIndex == -1) {
+				if (features & ENVIRONMENT_MAP_FEATURE) {
+					colours[streamed.pixel] += ray.throughput * environmentMap.lookup(ray.direction, ray.roughness);
+				}
+				continue;
+			}
+			if (ray.depth == 0) {
+				pixels[streamed.pixel].sample.triangleIndex = intersection.triangleIndex;
+				recordPrimaryHit(pixels[streamed.pixel], intersection);
+			}
+
+			uint32_t pixelX = streamed.pixel % WIDTH;
+			uint32_t pixelY = streamed.pixel / WIDTH;
+			uint32_t raySeed = sampleHash(pixelSeed(pixelX, pixelY) + streamed.rayNumber);
+			std::array<PendingRay, 2> sent;
+			int sentCount = 0;
+			auto lightDiffuse = [&](const glm::vec3 &point, const glm::vec3 &normal, const glm::vec3 &tint) {
+				diffuseHits.push_back(StreamedDiffuseHit{streamed.pixel, point, normal, tint, raySeed});
+			};
+			scatterRay(ray, intersection, raySeed, lightDiffuse, [&](const PendingRay &next) {
+				if (!isRayNegligible(next)) sent[sentCount++] = next;
+			});
+			// traceSample's stack has it trace the last ray sent straight after this one
+			for (int j = 0; j < sentCount; j++) {
+				nextWave.push_back(StreamedRay{streamed.pixel, sent[j], streamed.rayNumber + sentCount - j});
+				nextRays.add(sent[j].origin, sent[j].direction);
+			}
+		}
+		lightStreamedHits<features>(diffuseHits, bounds, colours, stats);
+		nextRays.trace(bounds, hits, stats, [](const StreamRay &ray, RayStats &rayStats) {
+			return closestHit(ray.origin, ray.direction, SECONDARY_RAY, rayStats);
+		});
+		wave.swap(nextWave);
+	}
+
+	for (size_t pixel : pixelIndices) {
+		glm::vec3 colour = glm::min(colours[pixel], glm::vec3(255));
+		pixels[pixel].sample.colour = packColour(Colour(colour.r, colour.g, colour.b));
+	}
+}
+
+template <unsigned features>
+struct RayTracePass {
+	static const unsigned usedFeatures = PHOTON_MAPPING_FEATURE | ENVIRONMENT_MAP_FEATURE | RAY_HEATMAP_FEATURE;
+	static void run(DrawingWindow &window);
+};
+
+template <unsigned features>
+void RayTracePass<features>::run(DrawingWindow &window) {
 	float focalLength = 2;
 	float imagePlaneScale = 280;
+	RayStats frameStats;
+	const bool heatmap = features & RAY_HEATMAP_FEATURE;
+	std::vector<uint64_t> traversalCosts(heatmap ? WIDTH * HEIGHT : 0);
 
+	// only pixels that can't be reprojected from the last frame are traced
+	std::vector<CachedPixel> pixels(WIDTH * HEIGHT);
+	std::vector<bool> needsTrace(WIDTH * HEIGHT, true);
+	bool isCacheCurrent = reprojectionCache.lightPosition == lightPosition &&
+		reprojectionCache.renderFeatures == features;
+	if (reprojection && isCacheCurrent) {
+		needsTrace = reprojectionCache.reproject(cameraPosition, cameraOrientation, focalLength, imagePlaneScale,
+			edgeContrastThreshold, reprojectionRefreshPeriod, pixels);
+	}
+	// the heatmap shows what each pixel's own rays cost, so it needs them traced one at a time
+	const bool packets = packetTracing && !heatmap;
+	const bool streamed = rayStreaming && !heatmap;
+	std::vector<size_t> streamedPixels;
+	std::vector<SceneHit> streamedPrimaryHits;
+	for (int blockY = 0; blockY < HEIGHT; blockY += 4) {
+		for (int blockX = 0; blockX < WIDTH; blockX += 4) {
+			RayPacket packet;
+			std::array<SceneHit, PACKET_SIZE> hits;
+			if (packets) {
+				packet.origin = cameraPosition;
+				for (int lane = 0; lane < PACKET_SIZE; lane++) {
+					int x = blockX + lane % 4;
+					int y = blockY + lane / 4;
+					if (x < WIDTH && y < HEIGHT && needsTrace[y*WIDTH + x]) {
+						packet.setRay(lane, primaryRayDirection(x, y), FLT_MAX);
+					}
+				}
+				packet.prepare();
+				closestPacketHits(packet, hits, frameStats);
+			}
+			for (int lane = 0; lane < PACKET_SIZE; lane++) {
+				int x = blockX + lane % 4;
+				int y = blockY + lane / 4;
+				size_t i = y*WIDTH + x;
+				if (x >= WIDTH || y >= HEIGHT || !needsTrace[i]) continue;
+				pixels[i] = CachedPixel{};
+				pixels[i].isExact = true;
+				if (streamed) {
+					streamedPixels.push_back(i);
+					streamedPrimaryHits.push_back(packets ? hits[lane] :
+						closestHit(cameraPosition, primaryRayDirection(x, y), PRIMARY_RAY, frameStats));
+					continue;
+				}
+				RayStats pixelStats;
+				pixels[i].sample = traceSample<features>(x, y, pixelStats, &pixels[i], packets ? &hits[lane] : nullptr);
+				if (heatmap) traversalCosts[i] = pixelStats.traversalCost();
+				frameStats += pixelStats;
+			}
+		}
+	}
+	if (streamed) traceStreamedSamples<features>(streamedPixels, streamedPrimaryHits, pixels, frameStats);
 	for (int y = 0; y < HEIGHT; y++) {
 		for (int x = 0; x < WIDTH; x++) {
-			float u = (x - WIDTH/2) / imagePlaneScale;
-			float v = -(y - HEIGHT/2) / imagePlaneScale;
-			glm::vec3 cameraToImagePlanePixel = glm::vec3(u, v, -focalLength);
-			glm::vec3 rayDirection = normalize(cameraToImagePlanePixel * cameraOrientation);
-			RayTriangleIntersection intersection = getClosestIntersection(cameraPosition, rayDirection);
-			if (intersection.triangleIndex != -1) {
-				if (!isPointInShadow(intersection.intersectionPoint)) {
-					window.setPixelColour(x, y, packColour(intersection.intersectedTriangle.colour));
-				}
+			size_t i = y*WIDTH + x;
+			primarySamples[i] = pixels[i].sample;
+			window.setPixelColour(x, y, pixels[i].sample.colour);
+		}
+	}
+	reprojectionCache.store(pixels, cameraPosition, cameraOrientation, lightPosition, features);
+
+	if (antiAliasing != NO_ANTI_ALIASING) {
+		// every sample differs from every other with a negative threshold, so supersampling doesn't need edges
+		float contrastThreshold = antiAliasing == SUPERSAMPLED_16X ? -1 : edgeContrastThreshold;
+		int depth = antiAliasing == SUPERSAMPLED_16X ? 2 : adaptiveSamplingDepth;
+		std::vector<bool> edges = antiAliasing == SUPERSAMPLED_16X ? std::vector<bool>(WIDTH * HEIGHT, true) :
+			findEdgePixels(primarySamples, WIDTH, HEIGHT, edgeContrastThreshold);
+		for (int y = 0; y < HEIGHT; y++) {
+			for (int x = 0; x < WIDTH; x++) {
+				size_t i = y*WIDTH + x;
+				if (!edges[i]) continue;
+				RayStats pixelStats;
+				TraceSample trace = [&](float sampleX, float sampleY) {
+					return traceSample<features>(sampleX, sampleY, pixelStats);
+				};
+				window.setPixelColour(x, y, adaptiveSample(trace, x, y, primarySamples[i], depth, contrastThreshold));
+				if (heatmap) traversalCosts[i] += pixelStats.traversalCost();
+				frameStats += pixelStats;
+			}
+		}
+	}
+
+	if (heatmap) {
+		for (int y = 0; y < HEIGHT; y++) {
+			for (int x = 0; x < WIDTH; x++) {
+				window.setPixelColour(x, y, heatmapColour(float(traversalCosts[y*WIDTH + x]) / heatmapMaximumCost));
 			}
 		}
 	}
+	rayStats.add(frameStats);
+}
+
+const auto rayTracePasses = featureDispatchTable<RayTracePass>();
+
+void draw(DrawingWindow &window) {
+	PROFILE_SCOPE("ray trace");
+	window.clearPixels();
+	rayStats.clear();
+	if (photonMapping && (!photonMap.isBuilt || photonMap.lightPosition != lightPosition)) emitPhotons();
+	rayTracePasses[frameRenderFeatures()](window);
+}
+
+// Rasterises the ID of the nearest triangle at each pixel, and where on it the pixel is, into the visibility buffer
+void drawVisibilityBuffer() {
+	visibilityBuffer.clear();
+	rasteriseScene([&](const ModelTriangle &, size_t triangleId, const ProjectedTriangle &projected) {
+		fillTriangle(projected.canvasTriangle, projected.barycentrics, [&](int x, int y, float depth, glm::vec3 barycentric) {
+			if (1/depth <= depthBuffer[y][x]) return;
+			depthBuffer[y][x] = 1/depth;
+			size_t i = y*WIDTH + x;
+			visibilityBuffer.triangleIndices[i] = triangleId;
+			visibilityBuffer.barycentrics[i] = glm::vec2(barycentric[1], barycentric[2]);
+		});
+	});
+}
+
+// Shadow rays for the hybrid renderer from each pixel of the visibility buffer
+template <unsigned features>
+struct HybridShadowPass {
+	static const unsigned usedFeatures = RAY_HEATMAP_FEATURE;
+	static void run(DrawingWindow &window);
+};
+
+template <unsigned features>
+void HybridShadowPass<features>::run(DrawingWindow &window) {
+	parallelFor(HEIGHT, [&](size_t y) {
+		RayStats rowStats;
+		for (size_t x = 0; x < WIDTH; x++) {
+			size_t i = y*WIDTH + x;
+			uint32_t triangleIndex = visibilityBuffer.triangleIndices[i];
+			if (triangleIndex == NO_TRIANGLE) {
+				window.setPixelColour(x, y, 0);
+				continue;
+			}
+			const ModelTriangle triangle = sceneTriangle(triangleIndex);
+			glm::vec2 barycentric = visibilityBuffer.barycentrics[i];
+			glm::vec3 point = triangle.vertices[0] +
+				barycentric[0] * (triangle.vertices[1] - triangle.vertices[0]) +
+				barycentric[1] * (triangle.vertices[2] - triangle.vertices[0]);
+			RayStats pixelStats;
+			float visibility = lightVisibilityAt(point, sampleHash(i), pixelStats);
+			if (features & RAY_HEATMAP_FEATURE) {
+				window.setPixelColour(x, y, heatmapColour(float(pixelStats.traversalCost()) / heatmapMaximumCost));
+			} else {
+				window.setPixelColour(x, y, visibility > 0 ? packColour(triangle.colour, visibility) : 0);
+			}
+			rowStats += pixelStats;
+		}
+		rayStats.add(rowStats);
+	});
+}
+
+const auto hybridShadowPasses = featureDispatchTable<HybridShadowPass>();
+
+// Draws the same image as the ray tracer, but finds what each pixel sees with the rasteriser so that the only rays
+// cast are shadow rays
+void drawHybrid(DrawingWindow &window) {
+	drawVisibilityBuffer();
+
+	PROFILE_SCOPE("shadow rays");
+	rayStats.clear();
+	hybridShadowPasses[frameRenderFeatures()](window);
+}
+
+class RayTracedRenderer : public Renderer {
+public:
+	const char *name() const override { return "ray traced"; }
+	void drawFrame(DrawingWindow &window) override { draw(window); }
+} rayTracedRenderer;
+
+class RasterisedRenderer : public Renderer {
+public:
+	const char *name() const override { return "rasterised"; }
+	void drawFrame(DrawingWindow &window) override { drawRasterised(window); }
+} rasterisedRenderer;
+
+class DeferredRenderer : public Renderer {
+public:
+	const char *name() const override { return "deferred"; }
+	void drawFrame(DrawingWindow &window) override { drawDeferred(window); }
+} deferredRenderer;
+
+class HybridRenderer : public Renderer {
+public:
+	const char *name() const override { return "hybrid"; }
+	void drawFrame(DrawingWindow &window) override { drawHybrid(window); }
+} hybridRenderer;
+
+class WireframeRenderer : public Renderer {
+public:
+	const char *name() const override { return "wireframe"; }
+	void drawFrame(DrawingWindow &window) override { drawWireframe(window); }
+} wireframeRenderer;
+
+// indexed by RenderMode
+Renderer *const renderers[] = {&rayTracedRenderer, &rasterisedRenderer, &deferredRenderer, &hybridRenderer,
+	&wireframeRenderer};
+
+void switchRenderMode(RenderMode mode) {
+	if (mode == renderMode) return;
+	renderMode = mode;
+	switchStart = profileClockNanoseconds();
+}
+
+// Marks everything worked out from the triangles, apart from the BVH, as needing working out again
+void invalidateSceneCaches() {
+	shadowMap.isRendered = false;
+	photonMap.isBuilt = false;
+	reprojectionCache.isValid = false;
+}
+
+// Rebuilds everything derived from the triangles. Call after changing them.
+void updateScene() {
+	sceneBvh = Bvh(triangles);
+	sceneWideBvh = WideBvh(sceneBvh);
+	trianglesRebuiltSinceWideBvh = 0;
+	invalidateSceneCaches();
+	// the animated triangles may not be there any more
+	animating = false;
+}
+
+// Like updateScene, for when the triangles have only moved: the BVH is refitted, and only rebuilt where that has made
+// it too slow (see Bvh::update)
+BvhUpdateStats updateMovedScene() {
+	std::vector<Aabb> bounds = triangleBounds(triangles);
+	BvhUpdateStats stats = sceneBvh.update(triangles, bounds, bvhRebuildRatio);
+	// the wide tree is refitted too, and only collapsed again once enough of the binary one has been rebuilt that it
+	// has fallen well behind
+	trianglesRebuiltSinceWideBvh += stats.trianglesRebuilt;
+	if (stats.wasFullRebuild || trianglesRebuiltSinceWideBvh > wideBvhRebuildFraction * triangles.size()) {
+		sceneWideBvh = WideBvh(sceneBvh);
+		trianglesRebuiltSinceWideBvh = 0;
+	} else {
+		sceneWideBvh.refit(bounds);
+	}
+	invalidateSceneCaches();
+	return stats;
+}
+
+// Starts sending these triangles round in a circle, one step a frame
+void startAnimating(const std::vector<size_t> &triangleIndices) {
+	animatedTriangles = triangleIndices;
+	animationRestVertices.clear();
+	for (size_t i : animatedTriangles) animationRestVertices.push_back(triangles[i].vertices);
+	animationFrame = 0;
+	animating = true;
+}
+
+// Moves the animated triangles one step further round a circle from where they started
+void animateScene() {
+	PROFILE_SCOPE("animate");
+	animationFrame++;
+	float angle = animationFrame * 0.05f;
+	glm::vec3 offset = glm::vec3(std::cos(angle) - 1, 0, std::sin(angle)) * 0.4f;
+	for (size_t i = 0; i < animatedTriangles.size(); i++) {
+		for (int j = 0; j < 3; j++) triangles[animatedTriangles[i]].vertices[j] = animationRestVertices[i][j] + offset;
+	}
+	updateMovedScene();
+}
+
+void loadCornellBox(const std::string &directory) {
+	materials.clear();
+	triangles.clear();
+	instancedScene.clear();
+	readMtlFile(directory + "/cornell-box.mtl", materials);
+	readObjFile(directory + "/cornell-box.obj", triangles, 1, materials);
+	updateScene();
+}
+
+// Replaces the scene with a generated one (see SceneGenerator.h). The Cornell box must already be loaded, as the
+// grid of boxes is made from it.
+void loadGeneratedScene(GeneratedSceneType type, size_t triangleCount, uint32_t seed) {
+	std::vector<ModelTriangle> box = triangles;
+	if (type != CORNELL_GRID) materials = generatedMaterials();
+	triangles.clear();
+	triangles.reserve(triangleCount);
+	generateScene(type, triangleCount, seed, box, meshSink(triangles, materials));
+	computeVertexNormals(triangles, 0, CREASE_ANGLE);
+	computeTangents(triangles, 0);
+	updateScene();
+}
+
+// Replaces the scene with copies of the Cornell box laid out as in the generated grid of boxes, but as instances of
+// one mesh rather than copies of its triangles, each turned a different way. triangleCount is rounded up to a whole
+// number of boxes. The Cornell box must already be loaded.
+void loadInstancedGrid(size_t triangleCount) {
+	std::vector<ModelTriangle> box = triangles;
+	std::vector<glm::vec3> offsets = cornellGridOffsets(box, (triangleCount + box.size() - 1) / box.size());
+	triangles.clear();
+	size_t mesh = instancedScene.addMesh(box);
+	glm::vec3 centre = Bvh(box).nodes[0].bounds.centre();
+	for (size_t i = 0; i < offsets.size(); i++) {
+		// turned about its centre by a quarter turn per copy
+		glm::mat4 transform = glm::translate(glm::mat4(), offsets[i] + centre);
+		transform = glm::rotate(transform, float(M_PI / 2) * (i % 4), glm::vec3(0, 1, 0));
+		instancedScene.addInstance(mesh, glm::translate(transform, -centre));
+	}
+	instancedScene.build();
+	updateScene();
+}
+
+// Loads the Cornell box, then replaces it with a generated scene (see parseGeneratedSceneType) or "instanced-grid" of
+// about triangleCount triangles, unless scene is "cornell-box"
+void loadNamedScene(const std::string &directory, const std::string &scene, size_t triangleCount) {
+	loadCornellBox(directory);
+	if (scene == "instanced-grid") loadInstancedGrid(triangleCount);
+	else if (scene != "cornell-box") loadGeneratedScene(parseGeneratedSceneType(scene), triangleCount, 1);
 }
 
 void handleEvent(SDL_Event event, DrawingWindow &window) {
@@ -339,6 +1850,139 @@ void handleEvent(SDL_Event event, DrawingWindow &window) {
 			glm::vec3 down = cameraOrientation * glm::vec3(0, -1, 0);
 			cameraPosition += down * 0.1f;
 		}
+		else if (event.key.keysym.sym == SDLK_1) {
+			switchRenderMode(RAY_TRACED);
+		}
+		else if (event.key.keysym.sym == SDLK_2) {
+			switchRenderMode(RASTERISED);
+		}
+		else if (event.key.keysym.sym == SDLK_3) {
+			switchRenderMode(DEFERRED);
+		}
+		else if (event.key.keysym.sym == SDLK_4) {
+			switchRenderMode(HYBRID);
+		}
+		else if (event.key.keysym.sym == SDLK_5) {
+			switchRenderMode(WIREFRAME);
+		}
+		else if (event.key.keysym.sym == SDLK_b) {
+			backfaceCulling = !backfaceCulling;
+		}
+		else if (event.key.keysym.sym == SDLK_o) {
+			occlusionCulling = !occlusionCulling;
+			std::cout << "occlusion culling " << (occlusionCulling ? "on" : "off") << std::endl;
+		}
+		else if (event.key.keysym.sym == SDLK_m) {
+			shadowMapping = !shadowMapping;
+			std::cout << "shadow mapping " << (shadowMapping ? "on" : "off") << std::endl;
+		}
+		else if (event.key.keysym.sym == SDLK_p) {
+			// cycle the percentage closer filtering kernel through 1x1, 3x3 and 5x5
+			shadowFilterRadius = (shadowFilterRadius + 1) % 3;
+		}
+		else if (event.key.keysym.sym == SDLK_v) {
+			shadingPrecision = ShadingPrecision((shadingPrecision + 1) % 2);
+			std::cout << (shadingPrecision == FAST_SHADING ? "fast" : "exact") << " deferred shading" << std::endl;
+		}
+		else if (event.key.keysym.sym == SDLK_h) {
+			showHud = !showHud;
+			profilingEnabled = showHud;
+		}
+		else if (event.key.keysym.sym == SDLK_t) {
+			std::ofstream trace("trace.json");
+			writeChromeTrace(trace);
+			std::cout << "wrote the last " << PROFILE_RING_SIZE << " events per thread to trace.json"
+				<< (showHud ? "" : " (profiling is off - press h to turn it on)") << std::endl;
+		}
+		else if (event.key.keysym.sym == SDLK_a) {
+			antiAliasing = AntiAliasing((antiAliasing + 1) % 3);
+			const char *names[] = {"off", "adaptive", "16x supersampling"};
+			std::cout << "ray tracer anti-aliasing " << names[antiAliasing] << std::endl;
+		}
+		else if (event.key.keysym.sym == SDLK_l) {
+			// cycle the light through a point, a rectangle the size of the Cornell box's light and a disk
+			if (areaLight.shape == POINT_LIGHT) {
+				areaLight = AreaLight(RECTANGLE_LIGHT, glm::vec3(0.65, 0, 0), glm::vec3(0, 0, 0.52));
+			} else if (areaLight.shape == RECTANGLE_LIGHT) {
+				areaLight = AreaLight(DISK_LIGHT, glm::vec3(0.55, 0, 0), glm::vec3(0, 0, 0.55));
+			} else {
+				areaLight = AreaLight();
+			}
+			const char *names[] = {"point", "rectangle", "disk"};
+			std::cout << names[areaLight.shape] << " light" << std::endl;
+			photonMap.isBuilt = false;
+			reprojectionCache.isValid = false;
+		}
+		else if (event.key.keysym.sym == SDLK_x) {
+			// try the ray tracer's materials out on the tall box
+			for (Material &material : materials) {
+				if (material.name != "Blue") continue;
+				material.type = MaterialType((material.type + 1) % 4);
+				material.roughness = 0.1;
+				std::cout << material << std::endl;
+				photonMap.isBuilt = false;
+				reprojectionCache.isValid = false;
+			}
+		}
+		else if (event.key.keysym.sym == SDLK_i) {
+			photonMapping = !photonMapping;
+			std::cout << "photon mapped indirect light " << (photonMapping ? "on" : "off") << std::endl;
+		}
+		else if (event.key.keysym.sym == SDLK_e) {
+			if (environmentMap.isLoaded()) {
+				environmentMap = EnvironmentMap();
+			} else {
+				try {
+					loadEnvironmentMap("../environment.ppm");
+				} catch (const std::exception &e) {
+					std::cout << "couldn't load ../environment.ppm: " << e.what() << std::endl;
+				}
+			}
+		}
+		else if (event.key.keysym.sym == SDLK_n) {
+			// send the tall box round in a circle, or put it back where it started
+			if (animating) {
+				for (size_t i = 0; i < animatedTriangles.size(); i++) {
+					triangles[animatedTriangles[i]].vertices = animationRestVertices[i];
+				}
+				updateMovedScene();
+				animating = false;
+			} else {
+				std::vector<size_t> tallBox;
+				for (size_t i = 0; i < triangles.size(); i++) {
+					if (materials[triangles[i].materialIndex].name == "Blue") tallBox.push_back(i);
+				}
+				startAnimating(tallBox);
+			}
+		}
+		else if (event.key.keysym.sym == SDLK_g) {
+			// swap the Cornell box for a grid of instances of it, or back
+			bool wasInstanced = !instancedScene.instances.empty();
+			loadNamedScene("..", wasInstanced ? "cornell-box" : "instanced-grid", instancedGridTriangles);
+		}
+		else if (event.key.keysym.sym == SDLK_j) {
+			packetTracing = !packetTracing;
+			std::cout << "packet tracing of primary rays " << (packetTracing ? "on" : "off") << std::endl;
+		}
+		else if (event.key.keysym.sym == SDLK_w) {
+			wideBvhTraversal = !wideBvhTraversal;
+			std::cout << "wide BVH traversal " << (wideBvhTraversal ? "on" : "off") << std::endl;
+		}
+		else if (event.key.keysym.sym == SDLK_s) {
+			rayStreaming = !rayStreaming;
+			std::cout << "streamed secondary, shadow and photon rays " << (rayStreaming ? "on" : "off") << std::endl;
+			photonMap.isBuilt = false;
+		}
+		else if (event.key.keysym.sym == SDLK_k) {
+			reprojection = !reprojection;
+			std::cout << "ray tracer reprojection " << (reprojection ? "on" : "off") << std::endl;
+		}
+		else if (event.key.keysym.sym == SDLK_c) {
+			rayHeatmap = !rayHeatmap;
+		}
+		else if (event.key.keysym.sym == SDLK_r) {
+			std::cout << rayStats.total() << std::endl;
+		}
 		else if (event.key.keysym.sym == SDLK_u) {
 			drawUnfilledTriangle(window, CanvasTriangle(CanvasPoint(rand()%WIDTH, rand()%HEIGHT),
 				CanvasPoint(rand()%WIDTH, rand()%HEIGHT), CanvasPoint(rand()%WIDTH, rand()%HEIGHT)),
@@ -355,13 +1999,437 @@ void handleEvent(SDL_Event event, DrawingWindow &window) {
 	}
 }
 
+void drawFrame(DrawingWindow &window) {
+	occlusionStats = OcclusionStats();
+	if (animating) animateScene();
+	renderers[renderMode]->drawFrame(window);
+}
+
+// Gives every material the texture and maps it over the scene's bounding box, projected along whichever axis each
+// triangle faces most
+void applyPlanarTexture(const std::string &textureFile) {
+	TextureMap texture(textureFile);
+	for (Material &material : materials) material.texture = texture;
+	Aabb bounds = sceneBvh.nodes[0].bounds;
+	for (ModelTriangle &triangle : triangles) {
+		glm::vec3 facing = glm::abs(triangle.normal);
+		int uAxis = facing.x >= facing.y && facing.x >= facing.z ? 2 : 0;
+		int vAxis = facing.y >= facing.z && facing.y > facing.x ? 2 : 1;
+		for (int i = 0; i < 3; i++) {
+			glm::vec3 position = (triangle.vertices[i] - bounds.min) / (bounds.max - bounds.min);
+			triangle.texturePoints[i] = TexturePoint(position[uAxis], position[vAxis]);
+		}
+	}
+	computeTangents(triangles, 0);
+}
+
+// Benchmark scenario: a fixed number of frames of one render mode, with the camera moving in a straight line
+struct BenchScenario {
+	std::string name;
+	RenderMode mode;
+	std::string scene;  // see loadNamedScene
+	size_t triangles;  // for generated and instanced scenes
+	bool textured;
+	int frames;
+	glm::vec3 cameraStart;
+	glm::vec3 cameraEnd;
+	bool occlusionCulling;  // for the rasterisers
+	bool animated;  // if so, the first quarter of the triangles move every frame, refitting the BVH (see animateScene)
+};
+
+// Runs every benchmark scenario headless, writes the results as JSON and optionally compares them with a baseline.
+// Options: --scene-dir <dir with cornell-box.obj> --output <file> --baseline <file> --tolerance <fraction>
+// --frames-scale <multiplier> --trace <file for a Chrome trace of the last frames>. Returns the exit code: non-zero
+// if anything regressed.
+int runBenchmarks(int argc, char *argv[]) {
+	std::string sceneDirectory = "..";
+	std::string outputFile;
+	std::string baselineFile;
+	double tolerance = 0.1;
+	float framesScale = 1;
+	std::string traceFile;
+	for (int i = 2; i+1 < argc; i += 2) {
+		std::string option = argv[i];
+		if (option == "--scene-dir") sceneDirectory = argv[i+1];
+		else if (option == "--output") outputFile = argv[i+1];
+		else if (option == "--baseline") baselineFile = argv[i+1];
+		else if (option == "--tolerance") tolerance = std::stod(argv[i+1]);
+		else if (option == "--frames-scale") framesScale = std::stof(argv[i+1]);
+		else if (option == "--trace") traceFile = argv[i+1];
+		else throw std::invalid_argument("Unknown benchmark option `" + option + "`");
+	}
+
+	const std::vector<BenchScenario> scenarios = {
+		{"cornell-rasterised", RASTERISED, "cornell-box", 0, false, 200,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, false},
+		{"cornell-deferred", DEFERRED, "cornell-box", 0, false, 200,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, false},
+		{"cornell-textured", DEFERRED, "cornell-box", 0, true, 200,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, false},
+		{"cornell-hybrid", HYBRID, "cornell-box", 0, false, 20,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, false},
+		{"cornell-ray-traced", RAY_TRACED, "cornell-box", 0, false, 10,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, false},
+		{"grid-2k-rasterised", RASTERISED, "cornell-grid", 2048, false, 100,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 0), true, false},
+		{"grid-2k-deferred", DEFERRED, "cornell-grid", 2048, false, 100,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 0), true, false},
+		{"spheres-100k-rasterised", RASTERISED, "spheres", 100000, false, 50,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, false},
+		{"soup-100k-rasterised", RASTERISED, "soup", 100000, false, 50,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, false},
+		{"occluders-100k-rasterised", RASTERISED, "occluders", 100000, false, 50,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, false},
+		{"occluders-100k-rasterised-unculled", RASTERISED, "occluders", 100000, false, 50,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), false, false},
+		{"spheres-10k-ray-traced", RAY_TRACED, "spheres", 10000, false, 5,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, false},
+		{"spheres-20k-ray-traced", RAY_TRACED, "spheres", 20000, false, 5,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, false},
+		{"spheres-20k-ray-traced-animated", RAY_TRACED, "spheres", 20000, false, 5,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 6), true, true},
+		{"instanced-grid-100k-ray-traced", RAY_TRACED, "instanced-grid", 100000, false, 5,
+			glm::vec3(-1, 0, 16), glm::vec3(1, 0.5, 0), true, false},
+	};
+
+	DrawingWindow window(WIDTH, HEIGHT);
+	std::vector<BenchResult> results;
+	profilingEnabled = !traceFile.empty();
+	for (const BenchScenario &scenario : scenarios) {
+		loadNamedScene(sceneDirectory, scenario.scene, scenario.triangles);
+		if (scenario.textured) applyPlanarTexture(sceneDirectory + "/texture.ppm");
+		renderMode = scenario.mode;
+		occlusionCulling = scenario.occlusionCulling;
+		if (scenario.animated) {
+			std::vector<size_t> moving(triangles.size() / 4);
+			std::iota(moving.begin(), moving.end(), 0);
+			startAnimating(moving);
+		}
+
+		BenchResult result(scenario.name, triangles.size() + instancedScene.triangleCount);
+		int frames = std::max(1, int(scenario.frames * framesScale));
+		for (int frame = 0; frame < frames; frame++) {
+			cameraPosition = glm::mix(scenario.cameraStart, scenario.cameraEnd, frames > 1 ? float(frame)/(frames-1) : 0.0f);
+			auto start = std::chrono::steady_clock::now();
+			rayStats.clear();
+			drawFrame(window);
+			window.renderFrame();
+			auto end = std::chrono::steady_clock::now();
+			result.frameMilliseconds.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+			result.rayStats += rayStats.total();
+			result.occlusionStats += occlusionStats;
+		}
+		result.peakRssKilobytes = peakRssKilobytes();
+		std::cerr << scenario.name << ": " << result.percentileFrameMilliseconds(50) << " ms median";
+		if (result.occlusionStats.trianglesTested > 0) {
+			std::cerr << ", " << result.occlusionStats.nodesCulledPercent() << "% of nodes and "
+				<< result.occlusionStats.trianglesCulledPercent() << "% of triangles culled";
+		}
+		// unculled and animated scenarios follow the same one culled and still, to show what the difference costs
+		if (!scenario.occlusionCulling && !results.empty()) {
+			std::cerr << ", " << results.back().percentileFrameMilliseconds(50) << " ms with culling";
+		}
+		if (scenario.animated && !results.empty()) {
+			std::cerr << ", " << results.back().percentileFrameMilliseconds(50) << " ms still";
+		}
+		std::cerr << std::endl;
+		results.push_back(result);
+	}
+
+	writeBenchJson(std::cout, results);
+	if (!traceFile.empty()) {
+		std::ofstream trace(traceFile);
+		writeChromeTrace(trace);
+	}
+	if (!outputFile.empty()) {
+		std::ofstream output(outputFile);
+		writeBenchJson(output, results);
+	}
+	if (!baselineFile.empty()) {
+		return compareWithBaseline(results, readBenchBaseline(baselineFile), tolerance, std::cerr) ? 0 : 1;
+	}
+	return 0;
+}
+
+// A reference view for the golden image checks
+struct GoldenView {
+	std::string name;
+	RenderMode mode;
+	std::string scene;  // see loadNamedScene
+	size_t triangles;  // for generated and instanced scenes
+	glm::vec3 cameraPosition;
+};
+
+// Renders each reference view headless and compares it with <name>.ppm in the reference directory. Where too many
+// pixels differ it fails the view and writes what was rendered (<name>-actual.ppm) and a picture of the differences
+// (<name>-diff.ppm) next to the reference. With --update it (re)writes the references instead.
+// Arguments: <reference dir> then options --update --scene-dir <dir with cornell-box.obj> --tolerance <colour
+// distance a pixel may be out by> --max-differing <fraction of pixels that may be out>. Returns the exit code:
+// non-zero if any view failed.
+int runGoldenChecks(int argc, char *argv[]) {
+	if (argc < 3) throw std::invalid_argument("Usage: --golden <reference dir> [options]");
+	std::string referenceDirectory = argv[2];
+	std::string sceneDirectory = "..";
+	bool update = false;
+	double tolerance = 0.02;
+	double maxDifferingFraction = 0.001;  // allows for a few pixels along edges
+	for (int i = 3; i < argc; i++) {
+		std::string option = argv[i];
+		if (option == "--update") update = true;
+		else if (option == "--scene-dir" && i+1 < argc) sceneDirectory = argv[++i];
+		else if (option == "--tolerance" && i+1 < argc) tolerance = std::stod(argv[++i]);
+		else if (option == "--max-differing" && i+1 < argc) maxDifferingFraction = std::stod(argv[++i]);
+		else throw std::invalid_argument("Unknown golden image option `" + option + "`");
+	}
+
+	const std::vector<GoldenView> views = {
+		{"cornell-rasterised", RASTERISED, "cornell-box", 0, glm::vec3(0, 0, 16)},
+		{"cornell-rasterised-near", RASTERISED, "cornell-box", 0, glm::vec3(0.5, 0.3, 2)},
+		{"cornell-deferred", DEFERRED, "cornell-box", 0, glm::vec3(0, 0, 16)},
+		{"cornell-hybrid", HYBRID, "cornell-box", 0, glm::vec3(0, 0, 16)},
+		{"cornell-ray-traced", RAY_TRACED, "cornell-box", 0, glm::vec3(0, 0, 16)},
+		{"cornell-ray-traced-side", RAY_TRACED, "cornell-box", 0, glm::vec3(1, 0.5, 8)},
+		{"spheres-2k-deferred", DEFERRED, "spheres", 2000, glm::vec3(0, 0, 12)},
+		{"occluders-2k-rasterised", RASTERISED, "occluders", 2000, glm::vec3(0, 0, 12)},
+	};
+
+	DrawingWindow window(WIDTH, HEIGHT);
+	int failures = 0;
+	for (const GoldenView &view : views) {
+		loadNamedScene(sceneDirectory, view.scene, view.triangles);
+		renderMode = view.mode;
+		cameraPosition = view.cameraPosition;
+		drawFrame(window);
+
+		std::string referenceFile = referenceDirectory + "/" + view.name + ".ppm";
+		if (update) {
+			window.savePPM(referenceFile);
+			std::cout << view.name << ": wrote " << referenceFile << std::endl;
+			continue;
+		}
+		if (!std::ifstream(referenceFile)) {
+			std::cout << view.name << ": FAILED, no reference " << referenceFile << " (run with --update)" << std::endl;
+			failures++;
+			continue;
+		}
+
+		std::vector<uint32_t> actual(WIDTH * HEIGHT);
+		for (size_t y = 0; y < HEIGHT; y++) {
+			for (size_t x = 0; x < WIDTH; x++) actual[y*WIDTH + x] = window.getPixelColour(x, y);
+		}
+		TextureMap reference(referenceFile);
+		if (reference.width != WIDTH || reference.height != HEIGHT) {
+			std::cout << view.name << ": FAILED, reference is " << reference.width << "x" << reference.height << std::endl;
+			failures++;
+			continue;
+		}
+		std::vector<uint32_t> diff;
+		ImageDifference difference = compareImages(actual, reference.pixels, tolerance, &diff);
+		bool passed = difference.differingFraction() <= maxDifferingFraction;
+		std::cout << view.name << ": " << (passed ? "passed" : "FAILED") << ", " << difference << std::endl;
+		if (!passed) {
+			failures++;
+			window.savePPM(referenceDirectory + "/" + view.name + "-actual.ppm");
+			writePpm(referenceDirectory + "/" + view.name + "-diff.ppm", WIDTH, HEIGHT, diff);
+		}
+	}
+	if (!update) std::cout << views.size() - failures << "/" << views.size() << " views passed" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
+
+// A scene for the self-checks
+struct SelfCheckScene {
+	std::string scene;  // see loadNamedScene
+	size_t triangles;  // for generated and instanced scenes
+	glm::vec3 cameraPosition;
+};
+
+// Whether the ray crosses the triangle's plane within a hair of one of its edges, where triangle tests that round
+// differently, such as the single ray and packet ones, can disagree over whether it hits
+bool isEdgeHit(const glm::vec3 &rayStart, const glm::vec3 &rayDirection, const ModelTriangle &triangle) {
+	glm::vec3 e0 = triangle.vertices[1] - triangle.vertices[0];
+	glm::vec3 e1 = triangle.vertices[2] - triangle.vertices[0];
+	glm::vec3 solution = inverse(glm::mat3(-rayDirection, e0, e1)) * (rayStart - triangle.vertices[0]);
+	const float margin = 1e-5f;
+	return std::abs(solution[1]) < margin || std::abs(solution[2]) < margin ||
+		std::abs(1 - solution[1] - solution[2]) < margin;
+}
+
+// Whether two closest hits of a ray agree: both missing, or both hitting at the same distance. Triangles hit at the
+// same distance, such as either side of an edge, can be found in either order, so which was found doesn't matter,
+// and nor does one only finding something further if the nearer hit is on the edge of its triangle.
+bool hitsAgree(const glm::vec3 &rayStart, const glm::vec3 &rayDirection, const SceneHit &a, const SceneHit &b) {
+	if (a.index == -1 && b.index == -1) return true;
+	if (a.index != -1 && b.index != -1 && std::abs(a.distance - b.distance) <= 1e-4f * std::max(1.0f, a.distance)) {
+		return true;
+	}
+	const SceneHit &nearer = b.index == -1 || (a.index != -1 && a.distance < b.distance) ? a : b;
+	return isEdgeHit(rayStart, rayDirection, sceneIntersection(rayStart, rayDirection, nearer).intersectedTriangle);
+}
+
+// Checks the faster ways of finding things against the plainer ones they stand in for, on the Cornell box and
+// generated scenes: closest hits through the wide BVHs against the binary ones, for every primary ray and for random
+// rays (half of them parallel to an axis, and some of those from a triangle's corner, along the faces of its boxes);
+// the hits of primary ray packets against single rays; and the nearest photons found in the photon map against a
+// search through all of them. Prints how many differ in each check.
+// Arguments: options --scene-dir <dir with cornell-box.obj>. Returns the exit code: non-zero if any differ.
+int runSelfChecks(int argc, char *argv[]) {
+	std::string sceneDirectory = "..";
+	for (int i = 2; i < argc; i++) {
+		std::string option = argv[i];
+		if (option == "--scene-dir" && i+1 < argc) sceneDirectory = argv[++i];
+		else throw std::invalid_argument("Unknown self-check option `" + option + "`");
+	}
+
+	const std::vector<SelfCheckScene> scenes = {
+		{"cornell-box", 0, glm::vec3(0, 0, 4)},
+		{"spheres", 10000, glm::vec3(0, 0, 8)},
+		{"soup", 10000, glm::vec3(0, 0, 8)},
+		{"occluders", 10000, glm::vec3(0, 0, 12)},
+		{"instanced-grid", 20000, glm::vec3(1, 0.5, 4)},
+	};
+	const uint32_t randomRayCount = 100000;
+	const uint32_t photonSearchCount = 1000;
+	const bool wasWideBvhTraversal = wideBvhTraversal;
+	RayStats stats;
+	size_t mismatches = 0;
+	for (const SelfCheckScene &scene : scenes) {
+		loadNamedScene(sceneDirectory, scene.scene, scene.triangles);
+		cameraPosition = scene.cameraPosition;
+
+		std::vector<glm::vec3> rayStarts;
+		std::vector<glm::vec3> rayDirections;
+		for (int y = 0; y < HEIGHT; y++) {
+			for (int x = 0; x < WIDTH; x++) {
+				rayStarts.push_back(cameraPosition);
+				rayDirections.push_back(primaryRayDirection(x, y));
+			}
+		}
+		Aabb bounds = sceneBounds();
+		for (uint32_t i = 0; i < randomRayCount; i++) {
+			uint32_t seed = sampleHash(i);
+			glm::vec3 start;
+			glm::vec3 direction;
+			for (int axis = 0; axis < 3; axis++) {
+				start[axis] = glm::mix(bounds.min[axis], bounds.max[axis], unitFloat(seed));
+				seed = sampleHash(seed);
+				direction[axis] = unitFloat(seed) - 0.5f;
+				seed = sampleHash(seed);
+			}
+			if (i % 2 == 1) {
+				direction = glm::vec3(0);
+				direction[i/2 % 3] = i/6 % 2 == 0 ? 1 : -1;
+				if (i % 4 == 3 && !triangles.empty()) start = triangles[seed % triangles.size()].vertices[i/4 % 3];
+			}
+			rayStarts.push_back(start);
+			rayDirections.push_back(glm::normalize(direction));
+		}
+		size_t wideMismatches = 0;
+		for (size_t i = 0; i < rayStarts.size(); i++) {
+			wideBvhTraversal = false;
+			SceneHit binaryHit = closestHit(rayStarts[i], rayDirections[i], SECONDARY_RAY, stats);
+			wideBvhTraversal = true;
+			SceneHit wideHit = closestHit(rayStarts[i], rayDirections[i], SECONDARY_RAY, stats);
+			if (!hitsAgree(rayStarts[i], rayDirections[i], binaryHit, wideHit)) wideMismatches++;
+		}
+		wideBvhTraversal = wasWideBvhTraversal;
+
+		size_t packetMismatches = 0;
+		for (int blockY = 0; blockY < HEIGHT; blockY += 4) {
+			for (int blockX = 0; blockX < WIDTH; blockX += 4) {
+				RayPacket packet;
+				packet.origin = cameraPosition;
+				for (int lane = 0; lane < PACKET_SIZE; lane++) {
+					int x = blockX + lane % 4;
+					int y = blockY + lane / 4;
+					if (x < WIDTH && y < HEIGHT) packet.setRay(lane, primaryRayDirection(x, y), FLT_MAX);
+				}
+				packet.prepare();
+				std::array<SceneHit, PACKET_SIZE> hits;
+				closestPacketHits(packet, hits, stats);
+				for (int lane = 0; lane < PACKET_SIZE; lane++) {
+					int x = blockX + lane % 4;
+					int y = blockY + lane / 4;
+					if (x >= WIDTH || y >= HEIGHT) continue;
+					glm::vec3 direction = primaryRayDirection(x, y);
+					SceneHit single = closestHit(cameraPosition, direction, PRIMARY_RAY, stats);
+					if (!hitsAgree(cameraPosition, direction, single, hits[lane])) packetMismatches++;
+				}
+			}
+		}
+		std::cout << scene.scene << ": " << wideMismatches << " of " << rayStarts.size()
+			<< " wide BVH hits differ, " << packetMismatches << " of " << WIDTH * HEIGHT << " packet hits differ"
+			<< std::endl;
+		mismatches += wideMismatches + packetMismatches;
+	}
+
+	// the photons are searched for around points anywhere in the box, and around photons, on the surfaces
+	loadNamedScene(sceneDirectory, "cornell-box", 0);
+	emitPhotons();
+	Aabb bounds = sceneBounds();
+	size_t photonMismatches = 0;
+	std::vector<std::pair<float, uint32_t>> nearest;
+	for (uint32_t i = 0; i < photonSearchCount; i++) {
+		uint32_t seed = sampleHash(i);
+		glm::vec3 point = photonMap.photons[seed % photonMap.photons.size()].position;
+		if (i % 2 == 0) {
+			for (int axis = 0; axis < 3; axis++) {
+				point[axis] = glm::mix(bounds.min[axis], bounds.max[axis], unitFloat(seed));
+				seed = sampleHash(seed);
+			}
+		}
+		float radiusSquared = photonMap.findNearest(point, photonGatherCount, photonGatherRadius, nearest);
+		std::vector<float> found;
+		for (const std::pair<float, uint32_t> &photon : nearest) found.push_back(photon.first);
+		std::sort(found.begin(), found.end());
+
+		std::vector<float> expected;
+		float expectedRadiusSquared = photonGatherRadius * photonGatherRadius;
+		for (const Photon &photon : photonMap.photons) {
+			glm::vec3 offset = photon.position - point;
+			float distanceSquared = glm::dot(offset, offset);
+			if (distanceSquared < expectedRadiusSquared) expected.push_back(distanceSquared);
+		}
+		std::sort(expected.begin(), expected.end());
+		if (expected.size() >= photonGatherCount) {
+			expected.resize(photonGatherCount);
+			expectedRadiusSquared = expected.back();
+		}
+		if (found != expected || radiusSquared != expectedRadiusSquared) photonMismatches++;
+	}
+	std::cout << "photon map: " << photonMismatches << " of " << photonSearchCount << " nearest photon searches differ"
+		<< std::endl;
+	mismatches += photonMismatches;
+
+	std::cout << (mismatches == 0 ? "self-checks passed" : "self-checks FAILED") << std::endl;
+	return mismatches == 0 ? 0 : 1;
+}
+
+// Writes a generated scene to an OBJ file (and an MTL file alongside it).
+// Arguments: <scene type> <triangle count> <output.obj> [seed] [dir with cornell-box.obj, for the grid of boxes]
+int runGenerator(int argc, char *argv[]) {
+	if (argc < 5) {
+		throw std::invalid_argument("Usage: --generate <scene type> <triangle count> <output.obj> [seed] [scene dir]");
+	}
+	GeneratedSceneType type = parseGeneratedSceneType(argv[2]);
+	size_t triangleCount = std::stoull(argv[3]);
+	uint32_t seed = argc > 5 ? std::stoul(argv[5]) : 1;
+	if (type == CORNELL_GRID) loadCornellBox(argc > 6 ? argv[6] : "..");
+	ObjWriter writer(argv[4], type == CORNELL_GRID ? materials : generatedMaterials());
+	generateScene(type, triangleCount, seed, triangles, writer.sink());
+	return 0;
+}
+
 int main(int argc, char *argv[]) {
+	if (argc > 1 && std::string(argv[1]) == "--bench") return runBenchmarks(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--generate") return runGenerator(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--golden") return runGoldenChecks(argc, argv);
+	if (argc > 1 && std::string(argv[1]) == "--self-check") return runSelfChecks(argc, argv);
+
 	DrawingWindow window = DrawingWindow(WIDTH, HEIGHT, false);
 	SDL_Event event;
 
-	readMtlFile("../cornell-box.mtl", colours);
-
-	readObjFile("../cornell-box.obj", triangles, 1, colours);
+	loadCornellBox("..");
 	// std::cout << triangles.size() << std::endl;
 	// for (size_t i = 0; i < triangles.size(); i++) {
 	// 	std::cout << triangles[i].colour << std::endl;
@@ -369,10 +2437,31 @@ int main(int argc, char *argv[]) {
 	// }
 
 	while (true) {
-		// We MUST poll for events - otherwise the window will freeze !
-		if (window.pollForInputEvents(event)) handleEvent(event, window);
-		draw(window);
-		// Need to render the frame at the end, or nothing actually gets shown on the screen !
-		window.renderFrame();
+		uint64_t frameStart = profileClockNanoseconds();
+		rayStats.clear();
+		{
+			PROFILE_SCOPE("events");
+			// We MUST poll for events - otherwise the window will freeze !
+			if (window.pollForInputEvents(event)) handleEvent(event, window);
+		}
+		drawFrame(window);
+		// the HUD shows the previous frame, as this one isn't finished until it's been presented
+		if (showHud) drawHud(window, hudStages, hudFrameMilliseconds, hudRaysPerSecond, hudOcclusionStats);
+		{
+			PROFILE_SCOPE("present");
+			// Need to render the frame at the end, or nothing actually gets shown on the screen !
+			window.renderFrame();
+		}
+		if (switchStart != 0) {
+			std::cout << "switched to " << renderers[renderMode]->name() << " renderer: first frame shown after "
+				<< (profileClockNanoseconds() - switchStart) / 1e6 << " ms" << std::endl;
+			switchStart = 0;
+		}
+		if (showHud) {
+			hudStages = summariseProfile(frameStart);
+			hudFrameMilliseconds = (profileClockNanoseconds() - frameStart) / 1e6;
+			hudRaysPerSecond = rayStats.total().rays() / (hudFrameMilliseconds / 1e3);
+			hudOcclusionStats = occlusionStats;
+		}
 	}
 }
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+
+// Render features that can be switched at runtime but stay the same for a whole frame. Loops that would otherwise
+// check them for every pixel or hit are templated on a mask of them instead, so each combination compiles to its own
+// loop with the checks folded away, and the frame's mask picks which one to run.
+enum RenderFeature {
+	SHADOW_MAPPING_FEATURE = 1 << 0,
+	FAST_SHADING_FEATURE = 1 << 1,  // approximate maths in the deferred lighting kernel
+	TEXTURE_FEATURE = 1 << 2,  // some material has a texture or normal map
+	PHOTON_MAPPING_FEATURE = 1 << 3,
+	ENVIRONMENT_MAP_FEATURE = 1 << 4,
+	RAY_HEATMAP_FEATURE = 1 << 5,
+};
+#define RENDER_FEATURE_COUNT 6
+
+template <unsigned... masks>
+struct FeatureMaskList {};
+
+// FeatureMaskList<0, 1, ..., count-1>
+template <unsigned count, unsigned... masks>
+struct AllFeatureMasks : AllFeatureMasks<count - 1, count - 1, masks...> {};
+template <unsigned... masks>
+struct AllFeatureMasks<0, masks...> {
+	typedef FeatureMaskList<masks...> type;
+};
+
+template <template <unsigned> class Pass, unsigned... masks>
+std::array<decltype(&Pass<0>::run), sizeof...(masks)> featureDispatchTable(FeatureMaskList<masks...>) {
+	return {{&Pass<masks & Pass<0>::usedFeatures>::run...}};
+}
+
+// Pointers to Pass<features>::run indexed by every mask of render features. Pass<features> is a class template with
+// a static run function and a usedFeatures mask of the features it looks at. Features it doesn't use are masked off
+// before instantiating it, so there's one specialisation per combination of the features it does use.
+template <template <unsigned> class Pass>
+std::array<decltype(&Pass<0>::run), 1 << RENDER_FEATURE_COUNT> featureDispatchTable() {
+	return featureDispatchTable<Pass>(typename AllFeatureMasks<1 << RENDER_FEATURE_COUNT>::type());
+}
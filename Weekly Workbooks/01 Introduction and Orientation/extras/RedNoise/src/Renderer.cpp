@@ -0,0 +1,3 @@
+#include "Renderer.h"
+
+Renderer::~Renderer() = default;
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <DrawingWindow.h>
+
+// One way of drawing the scene. Renderers hold no scene state of their own: the triangles, acceleration structures,
+// textures, camera and buffers are shared between them all, so switching renderer doesn't rebuild anything.
+class Renderer {
+public:
+	virtual ~Renderer();
+	virtual const char *name() const = 0;
+	virtual void drawFrame(DrawingWindow &window) = 0;
+};
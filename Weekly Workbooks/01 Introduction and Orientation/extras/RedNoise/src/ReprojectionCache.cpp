@@ -0,0 +1,78 @@
+#include "ReprojectionCache.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+ReprojectionCache::ReprojectionCache() = default;
+
+ReprojectionCache::ReprojectionCache(size_t w, size_t h) : width(w), height(h), pixels(w * h) {}
+
+std::vector<bool> ReprojectionCache::reproject(const glm::vec3 &newCameraPosition,
+		const glm::mat3 &newCameraOrientation, float focalLength, float imagePlaneScale, float contrastThreshold,
+		uint32_t refreshPeriod, std::vector<CachedPixel> &reprojected) const {
+	reprojected.assign(width * height, CachedPixel{});
+	std::vector<bool> needsTrace(width * height, true);
+	if (!isValid) return needsTrace;
+	bool isSameView = newCameraPosition == cameraPosition && newCameraOrientation == cameraOrientation;
+
+	std::vector<float> depths(width * height, FLT_MAX);
+	int furthestMoved = 0;
+	for (size_t y = 0; y < height; y++) {
+		for (size_t x = 0; x < width; x++) {
+			const CachedPixel &pixel = pixels[y*width + x];
+			if (!pixel.isReusable || (isSameView && !pixel.isExact)) continue;
+			// same projection as the ray tracer's primary rays, backwards
+			glm::vec3 wrtCamera = newCameraOrientation * (pixel.hitPosition - newCameraPosition);
+			float depth = -wrtCamera.z;
+			if (depth <= 0) continue;
+			float u = focalLength * wrtCamera.x / depth;
+			float v = focalLength * wrtCamera.y / depth;
+			int newX = int(std::round(u * imagePlaneScale + width/2.0f));
+			int newY = int(std::round(-v * imagePlaneScale + height/2.0f));
+			if (newX < 0 || newY < 0 || newX >= int(width) || newY >= int(height)) continue;
+			furthestMoved = std::max(furthestMoved, std::max(std::abs(newX - int(x)), std::abs(newY - int(y))));
+
+			size_t i = newY*width + newX;
+			if (depth >= depths[i]) continue;
+			depths[i] = depth;
+			reprojected[i] = pixel;
+			reprojected[i].isExact = isSameView;
+			needsTrace[i] = false;
+		}
+	}
+
+	// nothing is on its way in when the camera hasn't moved, and everything kept is exact so needn't be refreshed
+	if (isSameView) return needsTrace;
+	int band = furthestMoved + 1;
+	std::vector<bool> isHole = needsTrace;
+	for (size_t y = 0; y < height; y++) {
+		for (size_t x = 0; x < width; x++) {
+			size_t i = y*width + x;
+			// holes are traced anyway, so only pixels that both got something are compared
+			if (!isHole[i] && x+1 < width && !isHole[i+1] &&
+					samplesDiffer(reprojected[i].sample, reprojected[i+1].sample, contrastThreshold)) {
+				needsTrace[i] = needsTrace[i+1] = true;
+			}
+			if (!isHole[i] && y+1 < height && !isHole[i+width] &&
+					samplesDiffer(reprojected[i].sample, reprojected[i+width].sample, contrastThreshold)) {
+				needsTrace[i] = needsTrace[i+width] = true;
+			}
+			bool isNearEdge = int(std::min(x, width-1 - x)) < band || int(std::min(y, height-1 - y)) < band;
+			// hashed rather than in rows or columns, so the refreshed pixels don't show up as a pattern
+			bool isRefreshed = sampleHash(uint32_t(i)) % refreshPeriod == frameCount % refreshPeriod;
+			if (isNearEdge || isRefreshed) needsTrace[i] = true;
+		}
+	}
+	return needsTrace;
+}
+
+void ReprojectionCache::store(const std::vector<CachedPixel> &frame, const glm::vec3 &camera,
+		const glm::mat3 &orientation, const glm::vec3 &light, unsigned features) {
+	pixels = frame;
+	cameraPosition = camera;
+	cameraOrientation = orientation;
+	lightPosition = light;
+	renderFeatures = features;
+	isValid = true;
+	frameCount++;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "AdaptiveSampling.h"
+
+// A pixel of a ray-traced frame, and what its primary ray hit
+struct CachedPixel {
+	PixelSample sample;
+	glm::vec3 hitPosition;
+	bool isReusable;  // the ray hit a surface whose colour doesn't depend on where it's seen from
+	bool isExact;  // traced through this pixel from the cache's camera, rather than reprojected from an earlier one
+};
+
+// The last ray-traced frame, kept so that when only the camera has moved, the next frame can reuse the pixels whose
+// surfaces are still in view instead of tracing them again
+class ReprojectionCache {
+public:
+	size_t width{};
+	size_t height{};
+	std::vector<CachedPixel> pixels;
+	glm::vec3 cameraPosition{};
+	glm::mat3 cameraOrientation{};
+	glm::vec3 lightPosition{};
+	unsigned renderFeatures{};  // see RenderFeatures.h
+	bool isValid{};  // false until a frame is stored, and once anything but the camera has changed since
+	uint32_t frameCount{};  // frames stored, for choosing which pixels to refresh
+
+	ReprojectionCache();
+	ReprojectionCache(size_t w, size_t h);
+	// Moves each reusable pixel to where the new camera sees its hit, keeping the nearest where several land on one
+	// pixel, and returns which pixels need tracing again:
+	// - those nothing landed on
+	// - those that differ from a neighbour (see samplesDiffer), as the nearest hit to the centre of a pixel on an edge
+	//   may not be what a ray through the centre would hit
+	// - those in a band around the edge of the image as wide as the furthest pixel moved, where things from outside the
+	//   last view could come in
+	// - a rotating 1/refreshPeriod of the rest, so that reused colours don't drift for long
+	// Pixels reprojected from an unchanged camera are exact only if they were traced from it, so it takes one more
+	// frame after the camera stops for the image to match a full trace.
+	std::vector<bool> reproject(const glm::vec3 &newCameraPosition, const glm::mat3 &newCameraOrientation,
+		float focalLength, float imagePlaneScale, float contrastThreshold, uint32_t refreshPeriod,
+		std::vector<CachedPixel> &reprojected) const;
+	void store(const std::vector<CachedPixel> &frame, const glm::vec3 &camera, const glm::mat3 &orientation,
+		const glm::vec3 &light, unsigned features);
+};
@@ -0,0 +1,51 @@
+#include "Scattering.h"
+#include <algorithm>
+#include <cmath>
+#include "AdaptiveSampling.h"
+
+float fresnelReflectance(float cosIncident, float etaIncident, float etaTransmitted) {
+	float sinTransmitted = etaIncident / etaTransmitted * std::sqrt(std::max(0.0f, 1 - cosIncident*cosIncident));
+	if (sinTransmitted >= 1) return 1;
+	float cosTransmitted = std::sqrt(std::max(0.0f, 1 - sinTransmitted*sinTransmitted));
+	float parallel = (etaTransmitted*cosIncident - etaIncident*cosTransmitted) /
+		(etaTransmitted*cosIncident + etaIncident*cosTransmitted);
+	float perpendicular = (etaIncident*cosIncident - etaTransmitted*cosTransmitted) /
+		(etaIncident*cosIncident + etaTransmitted*cosTransmitted);
+	return (parallel*parallel + perpendicular*perpendicular) / 2;
+}
+
+float dielectricDirections(const glm::vec3 &direction, const glm::vec3 &outwardNormal, float refractiveIndex,
+		glm::vec3 &reflected, glm::vec3 &refracted) {
+	// a ray going the same way as the outward normal is leaving the object
+	float cosIncident = -glm::dot(direction, outwardNormal);
+	bool entering = cosIncident > 0;
+	glm::vec3 normal = entering ? outwardNormal : -outwardNormal;
+	float etaIncident = entering ? 1 : refractiveIndex;
+	float etaTransmitted = entering ? refractiveIndex : 1;
+	float reflectance = fresnelReflectance(std::abs(cosIncident), etaIncident, etaTransmitted);
+	reflected = glm::reflect(direction, normal);
+	if (reflectance < 1) refracted = glm::refract(direction, normal, etaIncident / etaTransmitted);
+	return reflectance;
+}
+
+glm::vec3 uniformSphereDirection(uint32_t seed) {
+	// uniform heights on a sphere cover equal areas (Archimedes)
+	float z = 2*unitFloat(seed) - 1;
+	float angle = float(2*M_PI) * unitFloat(sampleHash(seed));
+	float r = std::sqrt(std::max(0.0f, 1 - z*z));
+	return glm::vec3(r*std::cos(angle), r*std::sin(angle), z);
+}
+
+glm::vec3 cosineHemisphereDirection(const glm::vec3 &normal, uint32_t seed) {
+	// the normal plus a uniform direction on the unit sphere around its tip is cosine-distributed
+	glm::vec3 direction = normal + uniformSphereDirection(seed);
+	float length = glm::length(direction);
+	return length > 1e-6f ? direction / length : normal;
+}
+
+glm::vec3 glossyReflection(const glm::vec3 &mirrorDirection, float roughness, uint32_t seed) {
+	// uniform in the unit ball: a uniform direction, at a distance whose cube is uniform
+	float distance = std::cbrt(unitFloat(sampleHash(sampleHash(seed))));
+	glm::vec3 offset = distance * uniformSphereDirection(seed);
+	return glm::normalize(mirrorDirection + roughness*offset);
+}
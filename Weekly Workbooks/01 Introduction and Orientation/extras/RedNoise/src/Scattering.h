@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Directions and weights for the secondary rays of the Mirrored Surfaces, Metallic and Refractive Materials workbooks.
+// Directions are normalised.
+
+// Fraction of unpolarised light reflected where a ray crosses from a medium of refractive index etaIncident into one
+// of etaTransmitted, at cosIncident to the normal (Fresnel's equations). The rest is refracted. Returns 1 for total
+// internal reflection.
+float fresnelReflectance(float cosIncident, float etaIncident, float etaTransmitted);
+// Uniformly random direction. The seed picks it.
+glm::vec3 uniformSphereDirection(uint32_t seed);
+// Random direction on the side of a surface the normal points to, more likely the closer it is to the normal (in
+// proportion to the cosine of the angle), as light scattered by a diffuse surface goes
+glm::vec3 cosineHemisphereDirection(const glm::vec3 &normal, uint32_t seed);
+// Directions a ray hitting a dielectric leaves in, reflected and refracted, given the normal that points out of the
+// object. Returns the fraction of light reflected (1 for total internal reflection, leaving refracted unset).
+float dielectricDirections(const glm::vec3 &direction, const glm::vec3 &outwardNormal, float refractiveIndex,
+	glm::vec3 &reflected, glm::vec3 &refracted);
+// The mirror direction pushed a random distance of up to roughness in a random direction, for glossy reflections.
+// The seed picks the direction.
+glm::vec3 glossyReflection(const glm::vec3 &mirrorDirection, float roughness, uint32_t seed);
@@ -0,0 +1,230 @@
+#include "SceneGenerator.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+#define GENERATED_REGION_SIZE 5.0f  // about the size of the Cornell box
+
+namespace {
+	// mt19937's output is the same everywhere, unlike the standard distributions, so scale it ourselves
+	class Random {
+	public:
+		explicit Random(uint32_t seed) : engine(seed) {}
+		float next() { return engine() / 4294967296.0f; }
+		float between(float low, float high) { return low + next() * (high - low); }
+		glm::vec3 inCube(float size) {
+			// separate statements, as the order function arguments are worked out in isn't fixed
+			float x = between(-0.5f, 0.5f);
+			float y = between(-0.5f, 0.5f);
+			float z = between(-0.5f, 0.5f);
+			return glm::vec3(x, y, z) * size;
+		}
+
+	private:
+		std::mt19937 engine;
+	};
+
+	// Passes triangles on until the budget is used up
+	class Budget {
+	public:
+		Budget(size_t count, const TriangleSink &s) : remaining(count), sink(s) {}
+		bool isSpent() const { return remaining == 0; }
+		void add(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, size_t materialIndex) {
+			if (remaining == 0) return;
+			sink(v0, v1, v2, materialIndex);
+			remaining--;
+		}
+
+	private:
+		size_t remaining;
+		const TriangleSink &sink;
+	};
+
+	// Latitude/longitude sphere with 2*rings segments around, split into triangles facing outwards
+	void addSphere(Budget &budget, const glm::vec3 &centre, float radius, int rings, size_t materialIndex) {
+		int segments = 2*rings;
+		auto point = [&](int ring, int segment) {
+			float latitude = float(M_PI) * ring / rings;
+			float longitude = 2 * float(M_PI) * segment / segments;
+			return centre + radius * glm::vec3(std::sin(latitude) * std::cos(longitude), std::cos(latitude),
+				-std::sin(latitude) * std::sin(longitude));
+		};
+		for (int ring = 0; ring < rings; ring++) {
+			for (int segment = 0; segment < segments; segment++) {
+				glm::vec3 topLeft = point(ring, segment), topRight = point(ring, segment+1);
+				glm::vec3 bottomLeft = point(ring+1, segment), bottomRight = point(ring+1, segment+1);
+				// the quads touching the poles only need one triangle
+				if (ring != 0) budget.add(topLeft, bottomLeft, topRight, materialIndex);
+				if (ring != rings-1) budget.add(topRight, bottomLeft, bottomRight, materialIndex);
+			}
+		}
+	}
+
+	// Rectangle facing +z split into a grid of cells x cells quads
+	void addWall(Budget &budget, const glm::vec3 &bottomLeft, float width, float height, int cells,
+			size_t materialIndex) {
+		glm::vec3 across(width / cells, 0, 0);
+		glm::vec3 up(0, height / cells, 0);
+		for (int y = 0; y < cells; y++) {
+			for (int x = 0; x < cells; x++) {
+				glm::vec3 corner = bottomLeft + float(x)*across + float(y)*up;
+				budget.add(corner, corner + across, corner + across + up, materialIndex);
+				budget.add(corner, corner + across + up, corner + up, materialIndex);
+			}
+		}
+	}
+
+	void generateSpheres(Budget &budget, size_t triangleCount, Random &random, size_t materialCount) {
+		// a sphere with r rings has 4r(r-1) triangles. Aim for spheres of up to 2000 triangles.
+		size_t perSphere = std::min(triangleCount, size_t(2000));
+		int rings = std::max(2, int(std::round(std::sqrt(perSphere / 4.0f))) + 1);
+		size_t sphereCount = std::max(size_t(1), triangleCount / (4*rings*(rings-1)));
+		float spacing = GENERATED_REGION_SIZE / std::cbrt(float(sphereCount));
+		while (!budget.isSpent()) {
+			float radius = spacing * random.between(0.2f, 0.5f);
+			glm::vec3 centre = random.inCube(GENERATED_REGION_SIZE - 2*radius);
+			addSphere(budget, centre, radius, rings, size_t(random.next() * materialCount));
+		}
+	}
+
+	void generateTriangleSoup(Budget &budget, size_t triangleCount, Random &random, size_t materialCount) {
+		// edges about twice the average spacing between triangles, so they overlap a fair bit
+		float edge = 2 * GENERATED_REGION_SIZE / std::cbrt(float(triangleCount));
+		while (!budget.isSpent()) {
+			glm::vec3 v0 = random.inCube(GENERATED_REGION_SIZE);
+			glm::vec3 v1 = v0 + random.inCube(edge);
+			glm::vec3 v2 = v0 + random.inCube(edge);
+			// all facing +z, towards where the camera usually is, so backface culling doesn't drop half of them
+			if (glm::cross(v1 - v0, v2 - v0).z < 0) std::swap(v1, v2);
+			budget.add(v0, v1, v2, size_t(random.next() * materialCount));
+		}
+	}
+
+	// Rows of walls across the view, one behind another, each hiding much of what's behind it
+	void generateOccluderField(Budget &budget, size_t triangleCount, Random &random, size_t materialCount) {
+		int cells = std::max(1, int(std::sqrt(std::min(triangleCount, size_t(512)) / 2.0f)));
+		size_t wallCount = std::max(size_t(1), triangleCount / (2*cells*cells));
+		int rows = std::max(1, int(std::sqrt(float(wallCount))));
+		float rowSpacing = GENERATED_REGION_SIZE / rows;
+		for (size_t wall = 0; !budget.isSpent(); wall++) {
+			// spread out within the row so that overlapping walls aren't in the same plane
+			float z = GENERATED_REGION_SIZE/2 - (wall % rows + random.between(0.1f, 0.9f)) * rowSpacing;
+			float width = random.between(0.2f, 0.6f) * GENERATED_REGION_SIZE;
+			float height = random.between(0.2f, 0.6f) * GENERATED_REGION_SIZE;
+			float centreX = random.between(-0.5f, 0.5f) * GENERATED_REGION_SIZE;
+			float centreY = random.between(-0.5f, 0.5f) * GENERATED_REGION_SIZE;
+			glm::vec3 bottomLeft(centreX - width/2, centreY - height/2, z);
+			addWall(budget, bottomLeft, width, height, cells, size_t(random.next() * materialCount));
+		}
+	}
+
+	// Copies of the box in a cube-shaped grid going back from the original, nearest layers first
+	void generateCornellGrid(Budget &budget, size_t triangleCount, const std::vector<ModelTriangle> &box) {
+		size_t copies = box.empty() ? 0 : (triangleCount + box.size() - 1) / box.size();
+		for (const glm::vec3 &offset : cornellGridOffsets(box, copies)) {
+			for (const ModelTriangle &triangle : box) {
+				budget.add(triangle.vertices[0] + offset, triangle.vertices[1] + offset, triangle.vertices[2] + offset,
+					triangle.materialIndex);
+			}
+		}
+	}
+}
+
+std::vector<glm::vec3> cornellGridOffsets(const std::vector<ModelTriangle> &box, size_t copies) {
+	if (box.empty()) throw std::invalid_argument("The Cornell box grid needs the Cornell box loaded");
+	glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+	for (const ModelTriangle &triangle : box) {
+		for (const glm::vec3 &vertex : triangle.vertices) {
+			boxMin = glm::min(boxMin, vertex);
+			boxMax = glm::max(boxMax, vertex);
+		}
+	}
+	glm::vec3 spacing = (boxMax - boxMin) * 1.25f;
+	int side = int(std::ceil(std::cbrt(float(copies))));  // copies across and up
+	std::vector<glm::vec3> offsets;
+	for (int z = 0; offsets.size() < copies; z++) {
+		for (int y = 0; y < side && offsets.size() < copies; y++) {
+			for (int x = 0; x < side && offsets.size() < copies; x++) {
+				offsets.push_back(glm::vec3(x - side/2, y - side/2, -z) * spacing);
+			}
+		}
+	}
+	return offsets;
+}
+
+void generateScene(GeneratedSceneType type, size_t triangleCount, uint32_t seed,
+		const std::vector<ModelTriangle> &box, const TriangleSink &sink) {
+	if (triangleCount == 0) return;
+	Budget budget(triangleCount, sink);
+	Random random(seed);
+	size_t materialCount = generatedMaterials().size();
+	switch (type) {
+		case SPHERES: generateSpheres(budget, triangleCount, random, materialCount); break;
+		case TRIANGLE_SOUP: generateTriangleSoup(budget, triangleCount, random, materialCount); break;
+		case CORNELL_GRID: generateCornellGrid(budget, triangleCount, box); break;
+		case OCCLUDER_FIELD: generateOccluderField(budget, triangleCount, random, materialCount); break;
+	}
+}
+
+std::vector<Material> generatedMaterials() {
+	return {
+		Material("Red", Colour("Red", 230, 60, 50)),
+		Material("Green", Colour("Green", 60, 200, 80)),
+		Material("Blue", Colour("Blue", 60, 90, 230)),
+		Material("Yellow", Colour("Yellow", 240, 210, 60)),
+		Material("White", Colour("White", 220, 220, 220)),
+		Material("Magenta", Colour("Magenta", 200, 70, 200)),
+	};
+}
+
+GeneratedSceneType parseGeneratedSceneType(const std::string &name) {
+	if (name == "spheres") return SPHERES;
+	if (name == "soup") return TRIANGLE_SOUP;
+	if (name == "cornell-grid") return CORNELL_GRID;
+	if (name == "occluders") return OCCLUDER_FIELD;
+	throw std::invalid_argument("Unknown scene type `" + name + "`");
+}
+
+TriangleSink meshSink(std::vector<ModelTriangle> &triangles, const std::vector<Material> &materials) {
+	return [&triangles, &materials](const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2,
+			size_t materialIndex) {
+		ModelTriangle triangle(v0, v1, v2, materials[materialIndex].colour);
+		triangle.normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+		triangle.materialIndex = materialIndex;
+		triangles.push_back(triangle);
+	};
+}
+
+ObjWriter::ObjWriter(const std::string &objFileName, const std::vector<Material> &m) :
+		file(objFileName), materials(m) {
+	if (!file) throw std::invalid_argument("Could not write `" + objFileName + "`");
+	std::string mtlFileName = objFileName.substr(0, objFileName.find_last_of('.')) + ".mtl";
+	std::ofstream mtlFile(mtlFileName);
+	for (const Material &material : materials) {
+		mtlFile << "newmtl " << material.name << "\n";
+		mtlFile << "Kd " << material.colour.red / 255.0f << " " << material.colour.green / 255.0f << " "
+			<< material.colour.blue / 255.0f << "\n";
+		mtlFile << "Ns " << material.specularExponent << "\n\n";
+	}
+	file << "mtllib " << mtlFileName.substr(mtlFileName.find_last_of('/') + 1) << "\n";
+}
+
+void ObjWriter::addTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, size_t materialIndex) {
+	if (materialIndex != currentMaterial) {
+		file << "usemtl " << materials[materialIndex].name << "\n";
+		currentMaterial = materialIndex;
+	}
+	for (const glm::vec3 &vertex : {v0, v1, v2}) {
+		file << "v " << vertex.x << " " << vertex.y << " " << vertex.z << "\n";
+	}
+	file << "f " << vertexCount+1 << "/ " << vertexCount+2 << "/ " << vertexCount+3 << "/\n";
+	vertexCount += 3;
+}
+
+TriangleSink ObjWriter::sink() {
+	return [this](const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, size_t materialIndex) {
+		addTriangle(v0, v1, v2, materialIndex);
+	};
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Material.h"
+#include "ModelTriangle.h"
+
+enum GeneratedSceneType { SPHERES, TRIANGLE_SOUP, CORNELL_GRID, OCCLUDER_FIELD };
+
+// Takes each generated triangle (wound anticlockwise seen from the front) and the index of its material. Generators
+// hand triangles over one at a time so that huge scenes can be streamed to a file without being held in memory.
+typedef std::function<void(const glm::vec3 &, const glm::vec3 &, const glm::vec3 &, size_t)> TriangleSink;
+
+// Scenes are generated to exactly triangleCount triangles, all within a region the size of the Cornell box centred
+// on the origin (the grid of Cornell boxes goes back into the distance instead), so bigger scenes are denser rather
+// than bigger. The same seed always gives the same scene on every platform.
+// box is the Cornell box's triangles, for the CORNELL_GRID scene; its materials are the box's own. The other scenes
+// use the materials from generatedMaterials().
+void generateScene(GeneratedSceneType type, size_t triangleCount, uint32_t seed,
+	const std::vector<ModelTriangle> &box, const TriangleSink &sink);
+std::vector<Material> generatedMaterials();
+// Where each copy of the box goes in the CORNELL_GRID scene, nearest layers first
+std::vector<glm::vec3> cornellGridOffsets(const std::vector<ModelTriangle> &box, size_t copies);
+// "spheres", "soup", "cornell-grid" or "occluders"
+GeneratedSceneType parseGeneratedSceneType(const std::string &name);
+
+// Adds generated triangles to a triangle list, in the same form readObjFile gives them
+TriangleSink meshSink(std::vector<ModelTriangle> &triangles, const std::vector<Material> &materials);
+
+// Writes generated triangles to an OBJ file, and their materials to an MTL file next to it
+class ObjWriter {
+public:
+	ObjWriter(const std::string &objFileName, const std::vector<Material> &materials);
+	void addTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, size_t materialIndex);
+	TriangleSink sink();
+
+private:
+	std::ofstream file;
+	std::vector<Material> materials;
+	size_t currentMaterial{SIZE_MAX};
+	size_t vertexCount{};
+};
@@ -0,0 +1,93 @@
+#include "ShadingKernels.h"
+#include <cmath>
+#include "Simd.h"
+
+namespace {
+	template <ShadingPrecision precision>
+	Float4 inverseLength(Float4 squaredLength) {
+		if (precision == FAST_SHADING) return fastInverseSqrt(squaredLength);
+		return Float4(1.0f) / sqrt(squaredLength);
+	}
+
+	template <ShadingPrecision precision>
+	Float4 power(Float4 x, Float4 y) {
+		if (precision == FAST_SHADING) return fastPow(x, y);
+		float lanes[4];
+		float exponents[4];
+		x.store(lanes);
+		y.store(exponents);
+		for (int i = 0; i < 4; i++) lanes[i] = std::pow(lanes[i], exponents[i]);
+		return Float4::load(lanes);
+	}
+}
+
+bool ShadingBatch::isFull() const {
+	return count == SHADING_BATCH_SIZE;
+}
+
+void ShadingBatch::add(const glm::vec3 &point, const glm::vec3 &normal, float specularExponent, float lightVisibility) {
+	pointX[count] = point.x;
+	pointY[count] = point.y;
+	pointZ[count] = point.z;
+	normalX[count] = normal.x;
+	normalY[count] = normal.y;
+	normalZ[count] = normal.z;
+	specularExponents[count] = specularExponent;
+	lightVisibilities[count] = lightVisibility;
+	count++;
+}
+
+template <ShadingPrecision precision>
+void shadeBatch(const ShadingBatch &batch, const ShadingLight &light, float *brightness) {
+	Float4 proximityScale(light.lightStrength / float(4 * M_PI));
+	// the last group of four can run past count into points left over from before, which are worked out and ignored
+	for (size_t i = 0; i < batch.count; i += 4) {
+		Float4 toLightX = Float4(light.lightPosition.x) - Float4::load(batch.pointX + i);
+		Float4 toLightY = Float4(light.lightPosition.y) - Float4::load(batch.pointY + i);
+		Float4 toLightZ = Float4(light.lightPosition.z) - Float4::load(batch.pointZ + i);
+		Float4 squaredDistance = dot(toLightX, toLightY, toLightZ, toLightX, toLightY, toLightZ);
+		Float4 inverseDistance = inverseLength<precision>(squaredDistance);
+		toLightX = toLightX * inverseDistance;
+		toLightY = toLightY * inverseDistance;
+		toLightZ = toLightZ * inverseDistance;
+
+		Float4 toViewerX = Float4(light.viewPosition.x) - Float4::load(batch.pointX + i);
+		Float4 toViewerY = Float4(light.viewPosition.y) - Float4::load(batch.pointY + i);
+		Float4 toViewerZ = Float4(light.viewPosition.z) - Float4::load(batch.pointZ + i);
+		Float4 inverseViewerDistance = inverseLength<precision>(dot(toViewerX, toViewerY, toViewerZ, toViewerX,
+			toViewerY, toViewerZ));
+		toViewerX = toViewerX * inverseViewerDistance;
+		toViewerY = toViewerY * inverseViewerDistance;
+		toViewerZ = toViewerZ * inverseViewerDistance;
+
+		Float4 normalX = Float4::load(batch.normalX + i);
+		Float4 normalY = Float4::load(batch.normalY + i);
+		Float4 normalZ = Float4::load(batch.normalZ + i);
+		Float4 inverseNormalLength = inverseLength<precision>(dot(normalX, normalY, normalZ, normalX, normalY,
+			normalZ));
+		normalX = normalX * inverseNormalLength;
+		normalY = normalY * inverseNormalLength;
+		normalZ = normalZ * inverseNormalLength;
+
+		Float4 normalDotLight = dot(normalX, normalY, normalZ, toLightX, toLightY, toLightZ);
+		Float4 proximity = min(Float4(1.0f), proximityScale * inverseDistance * inverseDistance);
+		Float4 diffuse = proximity * max(Float4(0.0f), normalDotLight);
+		// the light reflected in the normal, dotted with the direction to the viewer
+		Float4 reflectionDotViewer = Float4(2.0f) * normalDotLight *
+			dot(normalX, normalY, normalZ, toViewerX, toViewerY, toViewerZ) -
+			dot(toLightX, toLightY, toLightZ, toViewerX, toViewerY, toViewerZ);
+		Float4 specular = power<precision>(max(Float4(0.0f), reflectionDotViewer),
+			Float4::load(batch.specularExponents + i));
+
+		Float4 lit = (diffuse + specular) * Float4::load(batch.lightVisibilities + i);
+		Float4 result = min(Float4(1.0f), max(Float4(light.ambientLight), lit));
+		if (i + 4 <= batch.count) {
+			result.store(brightness + i);
+		} else {
+			for (size_t j = i; j < batch.count; j++) brightness[j] = result[int(j - i)];
+		}
+	}
+}
+
+template void shadeBatch<EXACT_SHADING>(const ShadingBatch &batch, const ShadingLight &light, float *brightness);
+template void shadeBatch<FAST_SHADING>(const ShadingBatch &batch, const ShadingLight &light, float *brightness);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+
+#define SHADING_BATCH_SIZE 64  // points per batch, a multiple of 4
+
+// EXACT_SHADING gives what computeBrightness does to within rounding. FAST_SHADING uses the approximate inverse
+// square root and pow in Simd.h, which put brightness out by up to about 1e-3 (for very high specular
+// exponents), under a third of a step of a colour channel.
+enum ShadingPrecision { EXACT_SHADING, FAST_SHADING };
+
+// What's the same for every point in a batch
+struct ShadingLight {
+	glm::vec3 lightPosition;
+	float lightStrength;
+	glm::vec3 viewPosition;
+	float ambientLight;
+};
+
+// Points to light, with one array per component (structure of arrays) so that the kernel can load the same component
+// of four points straight into a register. Normals needn't be unit length: the kernel normalises them.
+struct ShadingBatch {
+	size_t count{};
+	float pointX[SHADING_BATCH_SIZE]{};
+	float pointY[SHADING_BATCH_SIZE]{};
+	float pointZ[SHADING_BATCH_SIZE]{};
+	float normalX[SHADING_BATCH_SIZE]{};
+	float normalY[SHADING_BATCH_SIZE]{};
+	float normalZ[SHADING_BATCH_SIZE]{};
+	float specularExponents[SHADING_BATCH_SIZE]{};
+	float lightVisibilities[SHADING_BATCH_SIZE]{};
+
+	bool isFull() const;
+	void add(const glm::vec3 &point, const glm::vec3 &normal, float specularExponent, float lightVisibility);
+};
+
+// computeBrightness (see Lighting.h) for every point in the batch, four at a time, into brightness[0 to count).
+// Instantiated for both precisions.
+template <ShadingPrecision precision>
+void shadeBatch(const ShadingBatch &batch, const ShadingLight &light, float *brightness);
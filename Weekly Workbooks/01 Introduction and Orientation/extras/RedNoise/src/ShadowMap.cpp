@@ -0,0 +1,71 @@
+#include "ShadowMap.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+	// the axis each face looks down, and which way is up in its image
+	const std::array<glm::vec3, 6> FORWARDS = {{
+		glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+		glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)}};
+	const std::array<glm::vec3, 6> UPS = {{
+		glm::vec3(0, 1, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, -1),
+		glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), glm::vec3(0, 1, 0)}};
+}
+
+ShadowCubeMap::ShadowCubeMap() = default;
+
+ShadowCubeMap::ShadowCubeMap(size_t res) : resolution(res) {
+	for (std::vector<float> &face : faces) face.resize(res * res);
+}
+
+void ShadowCubeMap::clear(const glm::vec3 &light) {
+	lightPosition = light;
+	for (std::vector<float> &face : faces) std::fill(face.begin(), face.end(), FLT_MAX);
+}
+
+glm::vec3 ShadowCubeMap::toFaceSpace(int face, const glm::vec3 &direction) {
+	glm::vec3 right = glm::cross(FORWARDS[face], UPS[face]);
+	return glm::vec3(glm::dot(direction, right), glm::dot(direction, UPS[face]), -glm::dot(direction, FORWARDS[face]));
+}
+
+int ShadowCubeMap::faceOf(const glm::vec3 &direction) {
+	glm::vec3 magnitude = glm::abs(direction);
+	if (magnitude.x >= magnitude.y && magnitude.x >= magnitude.z) return direction.x > 0 ? 0 : 1;
+	if (magnitude.y >= magnitude.z) return direction.y > 0 ? 2 : 3;
+	return direction.z > 0 ? 4 : 5;
+}
+
+float ShadowCubeMap::visibility(const glm::vec3 &point, const glm::vec3 &normal, int kernelRadius) const {
+	glm::vec3 fromLight = point - lightPosition;
+	float distance = glm::length(fromLight);
+	// a texel covers about 2*distance/resolution of the surface, so push the lookup off the surface by more than that
+	// to stop it shadowing itself (acne). Always push towards the light side of the surface.
+	glm::vec3 offsetNormal = glm::dot(normal, fromLight) > 0 ? -normal : normal;
+	glm::vec3 lookup = fromLight + offsetNormal * (3 * distance / resolution);
+
+	int face = faceOf(lookup);
+	glm::vec3 wrtFace = toFaceSpace(face, lookup);
+	float depth = -wrtFace.z;
+	float halfResolution = resolution / 2.0f;
+	// same projection as the rasteriser with a focal length of 1, which gives the face a 90 degree view
+	float u = wrtFace.x / depth * halfResolution + halfResolution;
+	float v = -wrtFace.y / depth * halfResolution + halfResolution;
+	// the rasteriser rounds to the nearest texel
+	int centreX = int(std::round(u));
+	int centreY = int(std::round(v));
+	float bias = 0.002f * depth;
+
+	// texels off the edge of the face are clamped to it rather than looked up on the neighbouring face
+	const std::vector<float> &depths = faces[face];
+	int lit = 0;
+	int last = int(resolution) - 1;
+	for (int y = centreY - kernelRadius; y <= centreY + kernelRadius; y++) {
+		for (int x = centreX - kernelRadius; x <= centreX + kernelRadius; x++) {
+			size_t i = std::min(std::max(y, 0), last) * resolution + std::min(std::max(x, 0), last);
+			if (depth - bias <= depths[i]) lit++;
+		}
+	}
+	int kernelWidth = 2*kernelRadius + 1;
+	return float(lit) / (kernelWidth * kernelWidth);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+
+// Depth of the nearest surface in every direction from a point light, stored as the six 90 degree views of a cube
+// (+x, -x, +y, -y, +z, -z). Each face is a square depth buffer looking down the face's axis, filled in by the
+// rasteriser, and holds the depth along that axis (not the distance from the light).
+class ShadowCubeMap {
+public:
+	size_t resolution{};
+	std::array<std::vector<float>, 6> faces;
+	glm::vec3 lightPosition{};
+	bool isRendered{};  // false until the faces have been drawn for lightPosition
+
+	ShadowCubeMap();
+	explicit ShadowCubeMap(size_t res);
+	void clear(const glm::vec3 &light);
+	// a direction from the light in the face's camera space (looking down -z with y up)
+	static glm::vec3 toFaceSpace(int face, const glm::vec3 &direction);
+	// fraction (0 to 1) of the filter kernel around the point that the light can reach: percentage closer filtering
+	// over a (2*kernelRadius+1)^2 block of texels
+	float visibility(const glm::vec3 &point, const glm::vec3 &normal, int kernelRadius) const;
+
+private:
+	static int faceOf(const glm::vec3 &direction);
+};
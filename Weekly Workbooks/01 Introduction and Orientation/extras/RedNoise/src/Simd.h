@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_SSE 1
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#endif
+
+// Four floats operated on together: an SSE register where there is one, otherwise a plain array the compiler can do
+// what it likes with. Only what the kernels need is here. Comparisons give masks, with every bit of a lane set where
+// the comparison is true. min and max are minps and maxps: where either operand is NaN they give the second one, which
+// the scalar versions match.
+struct Float4 {
+#if SIMD_SSE
+	__m128 v;
+
+	Float4() : v(_mm_setzero_ps()) {}
+	Float4(__m128 value) : v(value) {}
+	Float4(float value) : v(_mm_set1_ps(value)) {}
+	static Float4 load(const float *p) { return _mm_loadu_ps(p); }
+	void store(float *p) const { _mm_storeu_ps(p, v); }
+	float operator[](int i) const { alignas(16) float lanes[4]; _mm_store_ps(lanes, v); return lanes[i]; }
+
+	friend Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+	friend Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+	friend Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+	friend Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+	friend Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+	friend Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+	friend Float4 sqrt(Float4 a) { return _mm_sqrt_ps(a.v); }
+	friend Float4 operator<(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+	friend Float4 operator<=(Float4 a, Float4 b) { return _mm_cmple_ps(a.v, b.v); }
+	friend Float4 operator>(Float4 a, Float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+	friend Float4 operator>=(Float4 a, Float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+	friend Float4 operator&(Float4 a, Float4 b) { return _mm_and_ps(a.v, b.v); }
+	friend Float4 operator|(Float4 a, Float4 b) { return _mm_or_ps(a.v, b.v); }
+	// bit i set where lane i of the mask is
+	friend int moveMask(Float4 mask) { return _mm_movemask_ps(mask.v); }
+	// about 12 bits from the hardware estimate, then one Newton-Raphson step for about 22
+	friend Float4 fastInverseSqrt(Float4 a) {
+		__m128 estimate = _mm_rsqrt_ps(a.v);
+		__m128 halfA = _mm_mul_ps(_mm_set1_ps(0.5f), a.v);
+		__m128 correction = _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(halfA, _mm_mul_ps(estimate, estimate)));
+		return _mm_mul_ps(estimate, correction);
+	}
+	// x = 2^exponent * mantissa with mantissa in [1, 2)
+	friend Float4 exponentOf(Float4 a) {
+		__m128i bits = _mm_castps_si128(a.v);
+		return _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+	}
+	friend Float4 mantissaOf(Float4 a) {
+		__m128i bits = _mm_castps_si128(a.v);
+		bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000));
+		return _mm_castsi128_ps(bits);
+	}
+	// 2^n for whole numbers n from -126 to 127
+	friend Float4 powerOfTwo(Float4 n) {
+		__m128i exponent = _mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127));
+		return _mm_castsi128_ps(_mm_slli_epi32(exponent, 23));
+	}
+	friend Float4 floor(Float4 a) {
+		// truncation rounds negative numbers up, so take one off where it did
+		__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+		return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a.v), _mm_set1_ps(1.0f)));
+	}
+#else
+	float v[4];
+
+	Float4() : v{0, 0, 0, 0} {}
+	Float4(float value) : v{value, value, value, value} {}
+	static Float4 load(const float *p) { Float4 a; std::copy(p, p+4, a.v); return a; }
+	void store(float *p) const { std::copy(v, v+4, p); }
+	float operator[](int i) const { return v[i]; }
+
+	template <typename Op>
+	friend Float4 lanewise(Float4 a, Float4 b, Op op) {
+		for (int i = 0; i < 4; i++) a.v[i] = op(a.v[i], b.v[i]);
+		return a;
+	}
+	friend Float4 operator+(Float4 a, Float4 b) { return lanewise(a, b, [](float x, float y) { return x + y; }); }
+	friend Float4 operator-(Float4 a, Float4 b) { return lanewise(a, b, [](float x, float y) { return x - y; }); }
+	friend Float4 operator*(Float4 a, Float4 b) { return lanewise(a, b, [](float x, float y) { return x * y; }); }
+	friend Float4 operator/(Float4 a, Float4 b) { return lanewise(a, b, [](float x, float y) { return x / y; }); }
+	friend Float4 min(Float4 a, Float4 b) { return lanewise(a, b, [](float x, float y) { return x < y ? x : y; }); }
+	friend Float4 max(Float4 a, Float4 b) { return lanewise(a, b, [](float x, float y) { return x > y ? x : y; }); }
+	friend Float4 sqrt(Float4 a) { return lanewise(a, a, [](float x, float) { return std::sqrt(x); }); }
+	static float fromBits(uint32_t bits) {
+		float lane;
+		std::memcpy(&lane, &bits, sizeof(lane));
+		return lane;
+	}
+	static float maskLane(bool isSet) { return fromBits(isSet ? 0xFFFFFFFF : 0); }
+	static uint32_t bitsOf(float lane) {
+		uint32_t bits;
+		std::memcpy(&bits, &lane, sizeof(bits));
+		return bits;
+	}
+	template <typename Op>
+	friend Float4 compare(Float4 a, Float4 b, Op op) {
+		for (int i = 0; i < 4; i++) a.v[i] = maskLane(op(a.v[i], b.v[i]));
+		return a;
+	}
+	friend Float4 operator<(Float4 a, Float4 b) { return compare(a, b, [](float x, float y) { return x < y; }); }
+	friend Float4 operator<=(Float4 a, Float4 b) { return compare(a, b, [](float x, float y) { return x <= y; }); }
+	friend Float4 operator>(Float4 a, Float4 b) { return compare(a, b, [](float x, float y) { return x > y; }); }
+	friend Float4 operator>=(Float4 a, Float4 b) { return compare(a, b, [](float x, float y) { return x >= y; }); }
+	friend Float4 operator&(Float4 a, Float4 b) {
+		return lanewise(a, b, [](float x, float y) { return fromBits(bitsOf(x) & bitsOf(y)); });
+	}
+	friend Float4 operator|(Float4 a, Float4 b) {
+		return lanewise(a, b, [](float x, float y) { return fromBits(bitsOf(x) | bitsOf(y)); });
+	}
+	friend int moveMask(Float4 mask) {
+		int bits = 0;
+		for (int i = 0; i < 4; i++) bits |= int(bitsOf(mask.v[i]) >> 31) << i;
+		return bits;
+	}
+	friend Float4 fastInverseSqrt(Float4 a) { return lanewise(a, a, [](float x, float) { return 1 / std::sqrt(x); }); }
+	friend Float4 exponentOf(Float4 a) {
+		return lanewise(a, a, [](float x, float) { int e; std::frexp(x, &e); return float(e - 1); });
+	}
+	friend Float4 mantissaOf(Float4 a) {
+		return lanewise(a, a, [](float x, float) { int e; return 2 * std::frexp(x, &e); });
+	}
+	friend Float4 powerOfTwo(Float4 n) { return lanewise(n, n, [](float x, float) { return std::ldexp(1.0f, int(x)); }); }
+	friend Float4 floor(Float4 a) { return lanewise(a, a, [](float x, float) { return std::floor(x); }); }
+#endif
+};
+
+inline Float4 dot(Float4 ax, Float4 ay, Float4 az, Float4 bx, Float4 by, Float4 bz) {
+	return ax*bx + ay*by + az*bz;
+}
+
+// log2 for positive x, good to about 2e-6: the exponent bits, plus log2 of the mantissa m from the series
+// ln m = 2 (t + t^3/3 + t^5/5 + ...) with t = (m-1)/(m+1), which is at most 1/3
+inline Float4 fastLog2(Float4 x) {
+	Float4 m = mantissaOf(x);
+	Float4 t = (m - Float4(1.0f)) / (m + Float4(1.0f));
+	Float4 t2 = t*t;
+	Float4 series = (((Float4(1/9.0f) * t2 + Float4(1/7.0f)) * t2 + Float4(1/5.0f)) * t2 + Float4(1/3.0f)) * t2 +
+		Float4(1.0f);
+	return exponentOf(x) + Float4(2 / 0.69314718f) * t * series;
+}
+
+// 2^x for x from -126 to 127, good to about 3e-6 relative: the nearest whole number goes straight into the exponent
+// bits, and the Taylor series of e^(f ln 2) does the fraction f, which is at most a half either way
+inline Float4 fastExp2(Float4 x) {
+	x = min(max(x, Float4(-126.0f)), Float4(127.0f));
+	Float4 whole = floor(x + Float4(0.5f));
+	Float4 f = (x - whole) * Float4(0.69314718f);
+	Float4 series = ((((Float4(1/120.0f) * f + Float4(1/24.0f)) * f + Float4(1/6.0f)) * f + Float4(0.5f)) * f +
+		Float4(1.0f)) * f + Float4(1.0f);
+	return powerOfTwo(whole) * series;
+}
+
+// x^y for x >= 0, as 2^(y log2 x). 0 for x below the smallest normal float, which is what a specular highlight wants.
+inline Float4 fastPow(Float4 x, Float4 y) {
+	Float4 result = fastExp2(y * fastLog2(max(x, Float4(1.2e-38f))));
+#if SIMD_SSE
+	return _mm_and_ps(result.v, _mm_cmpge_ps(x.v, _mm_set1_ps(1.2e-38f)));
+#else
+	for (int i = 0; i < 4; i++) if (!(x.v[i] >= 1.2e-38f)) result.v[i] = 0;
+	return result;
+#endif
+}
+
+// Eight floats operated on together: an AVX register with AVX2, otherwise a pair of Float4s. Only what wide BVH
+// traversal needs is here.
+struct Float8 {
+#if SIMD_AVX2
+	__m256 v;
+
+	Float8(__m256 value) : v(value) {}
+	Float8(float value) : v(_mm256_set1_ps(value)) {}
+	// eight bytes, each as a float from 0 to 255
+	static Float8 fromBytes(const uint8_t *p) {
+		return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))));
+	}
+	void store(float *p) const { _mm256_storeu_ps(p, v); }
+
+	friend Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.v, b.v); }
+	friend Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.v, b.v); }
+	friend Float8 min(Float8 a, Float8 b) { return _mm256_min_ps(a.v, b.v); }
+	friend Float8 max(Float8 a, Float8 b) { return _mm256_max_ps(a.v, b.v); }
+	friend Float8 operator<=(Float8 a, Float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+	friend int moveMask(Float8 mask) { return _mm256_movemask_ps(mask.v); }
+#else
+	Float4 low;
+	Float4 high;
+
+	Float8(Float4 lowHalf, Float4 highHalf) : low(lowHalf), high(highHalf) {}
+	Float8(float value) : low(value), high(value) {}
+	static Float8 fromBytes(const uint8_t *p) {
+#if SIMD_SSE
+		// widened to 16 and then 32 bits by interleaving with zeros
+		__m128i zero = _mm_setzero_si128();
+		__m128i shorts = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), zero);
+		return Float8(_mm_cvtepi32_ps(_mm_unpacklo_epi16(shorts, zero)),
+			_mm_cvtepi32_ps(_mm_unpackhi_epi16(shorts, zero)));
+#else
+		float lanes[8];
+		for (int i = 0; i < 8; i++) lanes[i] = p[i];
+		return Float8(Float4::load(lanes), Float4::load(lanes + 4));
+#endif
+	}
+	void store(float *p) const { low.store(p); high.store(p + 4); }
+
+	friend Float8 operator+(Float8 a, Float8 b) { return Float8(a.low + b.low, a.high + b.high); }
+	friend Float8 operator*(Float8 a, Float8 b) { return Float8(a.low * b.low, a.high * b.high); }
+	friend Float8 min(Float8 a, Float8 b) { return Float8(min(a.low, b.low), min(a.high, b.high)); }
+	friend Float8 max(Float8 a, Float8 b) { return Float8(max(a.low, b.low), max(a.high, b.high)); }
+	friend Float8 operator<=(Float8 a, Float8 b) { return Float8(a.low <= b.low, a.high <= b.high); }
+	friend int moveMask(Float8 mask) { return moveMask(mask.low) | moveMask(mask.high) << 4; }
+#endif
+};
@@ -0,0 +1,15 @@
+#include "VisibilityBuffer.h"
+#include <algorithm>
+
+VisibilityBuffer::VisibilityBuffer() = default;
+
+VisibilityBuffer::VisibilityBuffer(size_t w, size_t h) :
+		width(w),
+		height(h),
+		triangleIndices(w * h, NO_TRIANGLE),
+		barycentrics(w * h) {}
+
+void VisibilityBuffer::clear() {
+	// barycentrics are only read where a triangle has been written
+	std::fill(triangleIndices.begin(), triangleIndices.end(), NO_TRIANGLE);
+}
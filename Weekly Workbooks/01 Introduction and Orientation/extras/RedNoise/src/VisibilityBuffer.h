@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+#define NO_TRIANGLE UINT32_MAX
+
+// The nearest triangle at each pixel and where on it the pixel lies, written by the rasteriser. Anything else about
+// the surface (position, normal, colour) can be looked up from the triangle, so this is all a later pass needs.
+struct VisibilityBuffer {
+	size_t width{};
+	size_t height{};
+	std::vector<uint32_t> triangleIndices;  // NO_TRIANGLE where nothing was drawn
+	// weights of the triangle's second and third vertices; the first vertex's weight is 1 minus both
+	std::vector<glm::vec2> barycentrics;
+
+	VisibilityBuffer();
+	VisibilityBuffer(size_t w, size_t h);
+	void clear();
+};
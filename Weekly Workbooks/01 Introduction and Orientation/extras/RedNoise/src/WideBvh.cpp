@@ -0,0 +1,155 @@
+#include "WideBvh.h"
+#include <algorithm>
+#include <cmath>
+
+static_assert(sizeof(WideBvhNode) == 80, "a wide BVH node should take 80 bytes");
+
+namespace {
+	// What a slot of a wide node is collapsed from: an interior node of the binary tree, or a run of triangles, which
+	// is either a binary leaf or part of one too big for a single slot
+	struct CollapsedChild {
+		Aabb bounds;
+		uint32_t binaryNode;  // UINT32_MAX for a run of triangles
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+
+		bool isExpandable() const {
+			return binaryNode != UINT32_MAX || triangleCount > WIDE_BVH_MAX_LEAF;
+		}
+	};
+
+	CollapsedChild collapsedChild(const Bvh &bvh, uint32_t nodeIndex) {
+		const BvhNode &node = bvh.nodes[nodeIndex];
+		if (node.isLeaf()) {
+			return CollapsedChild{node.bounds, UINT32_MAX, node.leftChildOrFirstTriangle, node.triangleCount};
+		}
+		return CollapsedChild{node.bounds, nodeIndex, 0, 0};
+	}
+
+	// Opens up the largest child that can be, into its two binary children or two halves of its triangles, until
+	// there are WIDE_BVH_WIDTH or none is left to open
+	std::vector<CollapsedChild> collapse(const Bvh &bvh, const CollapsedChild &parent) {
+		std::vector<CollapsedChild> children = {parent};
+		while (children.size() < WIDE_BVH_WIDTH) {
+			int largest = -1;
+			for (size_t i = 0; i < children.size(); i++) {
+				if (!children[i].isExpandable()) continue;
+				if (largest == -1 || children[i].bounds.surfaceArea() > children[largest].bounds.surfaceArea()) {
+					largest = i;
+				}
+			}
+			if (largest == -1) break;
+			CollapsedChild expanded = children[largest];
+			if (expanded.binaryNode != UINT32_MAX) {
+				uint32_t left = bvh.nodes[expanded.binaryNode].leftChildOrFirstTriangle;
+				children[largest] = collapsedChild(bvh, left);
+				children.push_back(collapsedChild(bvh, left + 1));
+			} else {
+				// the halves keep the whole run's bounds, as the triangles aren't here to fit them tighter
+				uint32_t half = expanded.triangleCount / 2;
+				children[largest].triangleCount = half;
+				children.push_back(CollapsedChild{expanded.bounds, UINT32_MAX, expanded.firstTriangle + half,
+					expanded.triangleCount - half});
+			}
+		}
+		return children;
+	}
+
+	// Sets the grid of one axis of the node over [boundsMin, boundsMax] and puts each child's bounds on it, rounded
+	// outwards so that the decoded bounds contain the real ones
+	void quantiseAxis(WideBvhNode &node, int axis, float boundsMin, float boundsMax, const Aabb *childBounds,
+			size_t childCount) {
+		float extent = boundsMax - boundsMin;
+		int exponent = extent > 0 ? int(std::ceil(std::log2(extent / 255))) : -126;
+		exponent = std::min(std::max(exponent, -126), 127);
+		while (exponent < 127 && boundsMin + 255*exponentScale(exponent) < boundsMax) exponent++;
+		float scale = exponentScale(exponent);
+		node.origin[axis] = boundsMin;
+		node.exponents[axis] = int8_t(exponent);
+		for (size_t i = 0; i < childCount; i++) {
+			float childMin = childBounds[i].min[axis];
+			float childMax = childBounds[i].max[axis];
+			int low = std::min(std::max(int(std::floor((childMin - boundsMin) / scale)), 0), 255);
+			int high = std::min(std::max(int(std::ceil((childMax - boundsMin) / scale)), 0), 255);
+			while (low > 0 && boundsMin + low*scale > childMin) low--;
+			while (high < 255 && boundsMin + high*scale < childMax) high++;
+			node.quantisedMin[axis][i] = uint8_t(low);
+			node.quantisedMax[axis][i] = uint8_t(high);
+		}
+	}
+
+	// Sets the node's grid over its children's bounds, which fill its first childCount slots, and puts them on it.
+	// The other slots are left empty. Returns the node's bounds.
+	Aabb quantise(WideBvhNode &node, const Aabb *childBounds, size_t childCount) {
+		Aabb bounds;
+		for (size_t i = 0; i < childCount; i++) bounds.grow(childBounds[i]);
+		for (int axis = 0; axis < 3; axis++) {
+			std::fill(node.quantisedMin[axis], node.quantisedMin[axis] + WIDE_BVH_WIDTH, 255);
+			std::fill(node.quantisedMax[axis], node.quantisedMax[axis] + WIDE_BVH_WIDTH, 0);
+			quantiseAxis(node, axis, bounds.min[axis], bounds.max[axis], childBounds, childCount);
+		}
+		return bounds;
+	}
+}
+
+WideBvh::WideBvh() = default;
+
+// Collapses the binary tree top-down, each wide node taking the binary nodes nearest its top that together make up
+// to eight subtrees, opening the largest first as the surface area heuristic would. Any left that still have
+// children become wide nodes in turn.
+WideBvh::WideBvh(const Bvh &bvh) {
+	if (bvh.nodes.empty()) return;
+	nodes.push_back(WideBvhNode());
+	std::vector<std::pair<uint32_t, CollapsedChild>> stack = {std::make_pair(0u, collapsedChild(bvh, 0))};
+	while (!stack.empty()) {
+		uint32_t nodeIndex = stack.back().first;
+		std::vector<CollapsedChild> children = collapse(bvh, stack.back().second);
+		stack.pop_back();
+
+		WideBvhNode node = WideBvhNode();
+		std::array<Aabb, WIDE_BVH_WIDTH> childBounds;
+		node.firstChild = nodes.size();
+		node.firstTriangle = triangleIndices.size();
+		for (size_t i = 0; i < children.size(); i++) {
+			const CollapsedChild &child = children[i];
+			childBounds[i] = child.bounds;
+			if (child.isExpandable()) {
+				node.interiorMask |= 1 << i;
+				stack.push_back(std::make_pair(uint32_t(nodes.size()), child));
+				nodes.push_back(WideBvhNode());
+			} else {
+				node.triangleCounts[i] = child.triangleCount;
+				triangleIndices.insert(triangleIndices.end(), bvh.triangleIndices.begin() + child.firstTriangle,
+					bvh.triangleIndices.begin() + child.firstTriangle + child.triangleCount);
+			}
+		}
+		quantise(node, childBounds.data(), children.size());
+		nodes[nodeIndex] = node;
+	}
+}
+
+void WideBvh::refit(const std::vector<Aabb> &primitiveBounds) {
+	// child nodes always come after their parent, so going backwards reaches each node after all of its children
+	std::vector<Aabb> nodeBounds(nodes.size());
+	for (size_t nodeIndex = nodes.size(); nodeIndex-- > 0;) {
+		WideBvhNode &node = nodes[nodeIndex];
+		std::array<Aabb, WIDE_BVH_WIDTH> childBounds;
+		size_t childCount = 0;
+		uint32_t nextChild = node.firstChild;
+		uint32_t nextTriangle = node.firstTriangle;
+		// the children fill the first slots, and a slot that is neither a node nor a leaf is the first empty one
+		for (; childCount < WIDE_BVH_WIDTH; childCount++) {
+			if (node.interiorMask & (1u << childCount)) {
+				childBounds[childCount] = nodeBounds[nextChild++];
+				continue;
+			}
+			uint32_t triangleCount = node.triangleCounts[childCount];
+			if (triangleCount == 0) break;
+			for (uint32_t i = nextTriangle; i < nextTriangle + triangleCount; i++) {
+				childBounds[childCount].grow(primitiveBounds[triangleIndices[i]]);
+			}
+			nextTriangle += triangleCount;
+		}
+		nodeBounds[nodeIndex] = quantise(node, childBounds.data(), childCount);
+	}
+}
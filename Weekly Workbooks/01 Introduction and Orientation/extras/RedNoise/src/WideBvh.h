@@ -0,0 +1,129 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Bvh.h"
+#include "RayStats.h"
+#include "Simd.h"
+
+#define WIDE_BVH_WIDTH 8  // children per node
+#define WIDE_BVH_MAX_LEAF 255  // triangles in a leaf child, so that its count fits in a byte
+// No child is more than this many levels below the root: each level goes at least one level down the binary tree
+// (see BVH_MAX_DEPTH), or halves a run of more than WIDE_BVH_MAX_LEAF triangles, which can happen at most 24 times
+#define WIDE_BVH_MAX_DEPTH (BVH_MAX_DEPTH + 24)
+
+// A node of a WideBvh. Its children's bounds are quantised to a byte per face, in steps of a grid over the node's
+// own bounds, rounded outwards so they still contain what they bound. 80 bytes for eight children, where a binary
+// BVH takes 32 per child. Nodes are 16-byte aligned, so none straddles more than two cache lines.
+struct alignas(16) WideBvhNode {
+	glm::vec3 origin;  // the grid's corner: the minimum of the node's bounds
+	int8_t exponents[3];  // the grid's spacing along each axis is 2^exponent
+	uint8_t interiorMask;  // bit i set if child i is a node rather than a leaf
+	uint32_t firstChild;  // index of the first child node; the others follow in order
+	uint32_t firstTriangle;  // in WideBvh::triangleIndices, of the first leaf child's triangles; the others follow
+	uint8_t triangleCounts[WIDE_BVH_WIDTH];  // of each leaf child, and 0 for nodes and empty slots
+	// each child's bounds along each axis, in grid steps. Empty slots have minimums of 255 and maximums of 0, which
+	// no ray can be between.
+	uint8_t quantisedMin[3][WIDE_BVH_WIDTH];
+	uint8_t quantisedMax[3][WIDE_BVH_WIDTH];
+};
+
+// An eight-wide BVH, made by collapsing a binary one, for tracing single rays. Each node visited tests all its
+// children at once, loading the bytes of their bounds straight into SIMD lanes, and the tree is under half the binary
+// one's size, so much more of it stays in the cache on big scenes. The binary tree it's made from is what gets built,
+// refitted and updated; this can be refitted alongside it, and made again from it once it has changed shape.
+class WideBvh {
+public:
+	std::vector<WideBvhNode> nodes;  // the root first, and every node's child nodes after it
+	std::vector<uint32_t> triangleIndices;
+
+	WideBvh();
+	explicit WideBvh(const Bvh &bvh);
+	// Fits the children's bounds to the triangles' bounds (see triangleBounds) again, bottom-up, after they've moved,
+	// and puts them back on their nodes' grids without changing the tree. They must be the same triangles in the same
+	// order.
+	void refit(const std::vector<Aabb> &primitiveBounds);
+};
+
+// 2^exponent, for exponents from -126 to 127, straight from the bits
+inline float exponentScale(int exponent) {
+	uint32_t bits = uint32_t(exponent + 127) << 23;
+	float scale;
+	std::memcpy(&scale, &bits, sizeof(scale));
+	return scale;
+}
+
+// Walks a wide BVH as traverseBvh walks a binary one, calling visitLeaf(firstTriangle, triangleCount,
+// closestDistance) for the leaf children the ray reaches, nearest first. visitLeaf tests the triangles from
+// bvh.triangleIndices[firstTriangle] on and shortens closestDistance when it finds something nearer. Children beyond
+// the nearest hit so far are skipped.
+template <typename VisitLeaf>
+void traverseWideBvh(const WideBvh &bvh, const glm::vec3 &rayStart, const glm::vec3 &rayDirection,
+		float &closestDistance, RayStats &stats, VisitLeaf visitLeaf) {
+	if (bvh.nodes.empty()) return;
+	// a node, or if it has a triangle count, a leaf's triangles; and where the ray enters it
+	struct Entry {
+		uint32_t index;
+		uint32_t triangleCount;
+		float distance;
+	};
+	float nearest = closestDistance;
+	glm::vec3 inverseDirection = slabInverseDirection(rayDirection);
+	std::array<Entry, (WIDE_BVH_WIDTH - 1) * WIDE_BVH_MAX_DEPTH + 1> stack;  // 7 children waiting per level
+	size_t stackSize = 0;
+	stack[stackSize++] = Entry{0, 0, 0};
+	while (stackSize > 0) {
+		Entry entry = stack[--stackSize];
+		// something nearer may have been found since it went on the stack
+		if (entry.distance > nearest) continue;
+		if (entry.triangleCount > 0) {
+			visitLeaf(entry.index, entry.triangleCount, nearest);
+			continue;
+		}
+		const WideBvhNode &node = bvh.nodes[entry.index];
+		stats.nodeVisits++;
+
+		// slab test on every child at once, as Aabb::rayEntryDistance does it, with a face q grid steps along crossed
+		// at (q*scale + origin - rayStart) * inverseDirection. A ray enters by the minimum faces along axes it goes up
+		// and by the maximum faces along axes it goes down.
+		Float8 entryDistances(0.0f);
+		Float8 exitDistances(nearest);
+		for (int axis = 0; axis < 3; axis++) {
+			Float8 scale(exponentScale(node.exponents[axis]));
+			Float8 offset(node.origin[axis] - rayStart[axis]);
+			Float8 inverse(inverseDirection[axis]);
+			bool isDown = inverseDirection[axis] < 0;
+			Float8 entryFaces = Float8::fromBytes(isDown ? node.quantisedMax[axis] : node.quantisedMin[axis]);
+			Float8 exitFaces = Float8::fromBytes(isDown ? node.quantisedMin[axis] : node.quantisedMax[axis]);
+			entryDistances = max((entryFaces*scale + offset) * inverse, entryDistances);
+			exitDistances = min((exitFaces*scale + offset) * inverse, exitDistances);
+		}
+		unsigned hits = moveMask(entryDistances <= exitDistances);
+		if (hits == 0) continue;
+
+		float distances[WIDE_BVH_WIDTH];
+		entryDistances.store(distances);
+		std::array<Entry, WIDE_BVH_WIDTH> children;
+		int childCount = 0;
+		uint32_t nextChild = node.firstChild;
+		uint32_t nextTriangle = node.firstTriangle;
+		for (int i = 0; i < WIDE_BVH_WIDTH; i++) {
+			bool isNode = node.interiorMask & (1u << i);
+			if (hits & (1u << i)) {
+				// in order of decreasing distance, so the nearest goes on the stack last and is visited next
+				Entry child = isNode ? Entry{nextChild, 0, distances[i]} :
+					Entry{nextTriangle, node.triangleCounts[i], distances[i]};
+				int j = childCount++;
+				for (; j > 0 && children[j - 1].distance < child.distance; j--) children[j] = children[j - 1];
+				children[j] = child;
+			}
+			if (isNode) nextChild++;
+			else nextTriangle += node.triangleCounts[i];
+		}
+		for (int i = 0; i < childCount; i++) stack[stackSize++] = children[i];
+	}
+	closestDistance = nearest;
+}